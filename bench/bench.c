@@ -0,0 +1,454 @@
+// Throughput benchmarks for the lexer, parser, compiler and virtual machine
+// over generated programs. Results are written as tab-separated lines:
+//
+//   version  benchmark  phase  unit  items  seconds  rate
+//
+// where `rate` is items per second. With `-c baseline.tsv` the rates are
+// compared against an earlier run, and the exit status is non-zero when any
+// of them dropped by more than the threshold (`-t`, in percent).
+//
+//   make bench [BENCH_OUTPUT=bench.tsv] [BASELINE=old.tsv]
+
+#include "arena.h"
+#include "array.h"
+#include "compiler.h"
+#include "intern.h"
+#include "lexer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "shape.h"
+#include "vm.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+#define BENCH_TIME 0.25
+#define BENCH_THRESHOLD 15.0
+
+struct benchmark
+{
+  const char *name;
+  void (*generate) (FILE *fd);
+};
+
+struct result
+{
+  char benchmark[64];
+  char phase[16];
+  double rate;
+};
+
+static void
+generate_statements (FILE *fd)
+{
+  for (int i = 0; i < 5000; ++i)
+    {
+      fprintf (fd, "v%d = (+ %d 1) -- statement %d\n", i, i, i);
+      if (i % 10 == 0)
+        fprintf (fd, "s%d = \"string number %d\"\n", i, i);
+    }
+
+  fprintf (fd, "=> v4999\n");
+}
+
+static void
+generate_nesting (FILE *fd)
+{
+  for (int i = 0; i < 20; ++i)
+    {
+      fprintf (fd, "n%d = ", i);
+      for (int j = 0; j < 500; ++j)
+        fprintf (fd, "(+ 1 ");
+      fprintf (fd, "0");
+      for (int j = 0; j < 500; ++j)
+        fprintf (fd, ")");
+      fprintf (fd, "\n");
+    }
+
+  fprintf (fd, "=> n19\n");
+}
+
+static void
+generate_structures (FILE *fd)
+{
+  for (int i = 0; i < 50; ++i)
+    {
+      fprintf (fd, "s%d = {", i);
+      for (int j = 0; j < 400; ++j)
+        fprintf (fd, " field%d = %d", j, j);
+      fprintf (fd, " }\n");
+      fprintf (fd, "(s%d 'field%d)\n", i, i * 7);
+    }
+
+  fprintf (fd, "=> (s49 'field399)\n");
+}
+
+static void
+generate_arrays (FILE *fd)
+{
+  for (int i = 0; i < 4; ++i)
+    {
+      fprintf (fd, "a%d = [", i);
+      for (int j = 0; j < 15000; ++j)
+        fprintf (fd, " %d", j);
+      fprintf (fd, " ]\n");
+    }
+
+  fprintf (fd, "=> (length a3)\n");
+}
+
+static void
+generate_numeric (FILE *fd)
+{
+  fprintf (fd, "a = [");
+  for (int j = 0; j < 15000; ++j)
+    fprintf (fd, " %d", j % 100);
+  fprintf (fd, " ]\nf = [");
+  for (int j = 0; j < 15000; ++j)
+    fprintf (fd, " %d.5", j % 100);
+  fprintf (fd, " ]\n");
+
+  for (int i = 0; i < 20; ++i)
+    fprintf (fd, "(sum a) (dot f f) (max f) (prefix-sum a) (add a a)"
+                 " (scale f 2.0) (filter f a)\n");
+
+  fprintf (fd, "=> (sum (mul a a))\n");
+}
+
+static void
+generate_recursion (FILE *fd)
+{
+  fprintf (fd, "fib = ([n] => ((if (< n 2) ([] => n)\n"
+               "  ([] => (+ (fib (- n 1)) (fib (- n 2)))))))\n"
+               "count = ([n] => ((if (< n 1) ([] => 0)\n"
+               "  ([] => (+ 1 (count (- n 1)))))))\n"
+               "(count 1000)\n"
+               "=> (fib 18)\n");
+}
+
+static const struct benchmark BENCHMARKS[] = {
+  { "statements", generate_statements },
+  { "nesting", generate_nesting },
+  { "structures", generate_structures },
+  { "arrays", generate_arrays },
+  { "numeric", generate_numeric },
+  { "recursion", generate_recursion }
+};
+
+static double
+bench_seconds (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+struct input
+{
+  char *buffer;
+  size_t length;
+  struct ast *ast;
+  struct function *function;
+};
+
+// A phase measures one iteration: it returns the time taken in seconds and
+// sets `*items` to the work done.
+typedef double (bench_phase_t) (struct input *input, size_t *items);
+
+static struct ast *
+bench_parse (struct input *input, struct arena *arena)
+{
+  struct lexer *lexer;
+  struct parser *parser;
+  struct ast *ast;
+
+  lexer = lexer_create (input->buffer, input->length, arena, true);
+  parser = parser_create (lexer);
+  ast = parser_parse (parser);
+
+  parser_destroy (parser);
+  lexer_destroy (lexer);
+
+  return ast;
+}
+
+static double
+bench_phase_lex (struct input *input, size_t *items)
+{
+  struct arena *arena = arena_create (ARENA_BLOCK_SIZE);
+  double start = bench_seconds ();
+  struct lexer *lexer;
+
+  lexer = lexer_create (input->buffer, input->length, arena, true);
+
+  for (*items = 0; lexer_next (lexer).type != TOKEN_EOF;)
+    ++*items;
+
+  lexer_destroy (lexer);
+
+  double elapsed = bench_seconds () - start;
+
+  arena_destroy (arena);
+
+  return elapsed;
+}
+
+// Parsing includes the lexer, which the parser pulls its tokens from.
+static double
+bench_phase_parse (struct input *input, size_t *items)
+{
+  struct arena *arena = arena_create (ARENA_BLOCK_SIZE);
+  double start = bench_seconds ();
+  struct ast *ast = bench_parse (input, arena);
+  double elapsed = bench_seconds () - start;
+
+  *items = ast_count (ast);
+  ast_destroy (ast);
+  arena_destroy (arena);
+
+  return elapsed;
+}
+
+// Resolving annotates the tree, so every iteration compiles a fresh one.
+static double
+bench_phase_compile (struct input *input, size_t *items)
+{
+  struct arena *arena = arena_create (ARENA_BLOCK_SIZE);
+  struct ast *ast = bench_parse (input, arena);
+  double start = bench_seconds ();
+
+  resolve (ast, arena);
+  function_destroy (compile (ast));
+
+  double elapsed = bench_seconds () - start;
+
+  *items = ast_count (ast);
+  ast_destroy (ast);
+  arena_destroy (arena);
+
+  return elapsed;
+}
+
+// Rewrites the first byte of the middle statement with itself, which makes
+// the parser redo that statement. The rate is in the nodes it rebuilt.
+static double
+bench_phase_reparse (struct input *input, size_t *items)
+{
+  struct arena *arena = arena_create (ARENA_BLOCK_SIZE);
+  struct ast_statement *statements = input->ast->statements;
+  struct parser_edit edit
+      = { statements[array_length (statements) / 2].offset, 1, 1 };
+  double start = bench_seconds ();
+  struct lexer *lexer;
+  struct parser *parser;
+
+  lexer = lexer_create (input->buffer, input->length, arena, true);
+  parser = parser_create (lexer);
+  input->ast = parser_reparse (parser, input->ast, &edit, 1);
+  *items = parser->nodes;
+
+  parser_destroy (parser);
+  lexer_destroy (lexer);
+
+  double elapsed = bench_seconds () - start;
+
+  arena_destroy (arena);
+
+  return elapsed;
+}
+
+static double
+bench_phase_evaluate (struct input *input, size_t *items)
+{
+  double start = bench_seconds ();
+  struct vm *vm = vm_create ();
+
+  vm_run (vm, input->function);
+  vm_destroy (vm);
+
+  *items = 1;
+
+  return bench_seconds () - start;
+}
+
+// Repeats `function` for at least BENCH_TIME and reports the fastest
+// iteration, which is much less noisy than the mean.
+static void
+bench_measure (struct input *input, const char *benchmark, const char *phase,
+               const char *unit, bench_phase_t *function, FILE *fd,
+               struct result *result)
+{
+  double best = 0;
+  double total = 0;
+  size_t items = 0;
+
+  for (size_t i = 0; i < 3 || total < BENCH_TIME; ++i)
+    {
+      double seconds = function (input, &items);
+
+      if (i == 0 || seconds < best)
+        best = seconds;
+
+      total += seconds;
+    }
+
+  snprintf (result->benchmark, sizeof (result->benchmark), "%s", benchmark);
+  snprintf (result->phase, sizeof (result->phase), "%s", phase);
+  result->rate = items / best;
+
+  fprintf (fd, "%s\t%s\t%s\t%s\t%zu\t%.6f\t%.1f\n", BENCH_VERSION, benchmark,
+           phase, unit, items, best, result->rate);
+  fflush (fd);
+}
+
+static size_t
+bench_run (const struct benchmark *benchmark, FILE *fd,
+           struct result *results)
+{
+  struct input input;
+  struct arena *arena;
+  FILE *source = open_memstream (&input.buffer, &input.length);
+
+  benchmark->generate (source);
+  fclose (source);
+
+  arena = arena_create (ARENA_BLOCK_SIZE);
+
+  input.ast = bench_parse (&input, arena);
+  resolve (input.ast, arena);
+  input.function = compile (input.ast);
+
+  bench_measure (&input, benchmark->name, "lex", "tokens", bench_phase_lex,
+                 fd, &results[0]);
+  bench_measure (&input, benchmark->name, "parse", "nodes",
+                 bench_phase_parse, fd, &results[1]);
+  bench_measure (&input, benchmark->name, "reparse", "nodes",
+                 bench_phase_reparse, fd, &results[2]);
+  bench_measure (&input, benchmark->name, "compile", "nodes",
+                 bench_phase_compile, fd, &results[3]);
+  bench_measure (&input, benchmark->name, "evaluate", "runs",
+                 bench_phase_evaluate, fd, &results[4]);
+
+  ast_destroy (input.ast);
+  function_destroy (input.function);
+  arena_destroy (arena);
+  free (input.buffer);
+
+  return 5;
+}
+
+static bool
+bench_compare (const char *path, struct result *results, size_t count,
+               double threshold)
+{
+  FILE *fd = fopen (path, "r");
+  bool regressed = false;
+  char line[256];
+
+  if (fd == NULL)
+    {
+      perror (path);
+      return true;
+    }
+
+  while (fgets (line, sizeof (line), fd) != NULL)
+    {
+      char benchmark[64], phase[16];
+      double rate;
+
+      if (sscanf (line, "%*s %63s %15s %*s %*s %*s %lf", benchmark, phase,
+                  &rate)
+          != 3)
+        continue;
+
+      for (size_t i = 0; i < count; ++i)
+        if (strcmp (results[i].benchmark, benchmark) == 0
+            && strcmp (results[i].phase, phase) == 0)
+          {
+            double change = (results[i].rate / rate - 1) * 100;
+            bool slower = change < -threshold;
+
+            fprintf (stderr, "%-12s %-10s %+7.1f%%%s\n", benchmark, phase,
+                     change, slower ? "  REGRESSION" : "");
+            regressed |= slower;
+          }
+    }
+
+  fclose (fd);
+
+  return regressed;
+}
+
+static _Noreturn void
+usage (const char *program)
+{
+  fprintf (stderr,
+           "usage: %s [-o results.tsv] [-c baseline.tsv] [-t percent] "
+           "[benchmark...]\n",
+           program);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t total = sizeof (BENCHMARKS) / sizeof (*BENCHMARKS);
+  struct result results[5 * sizeof (BENCHMARKS) / sizeof (*BENCHMARKS)];
+  const char *baseline = NULL;
+  double threshold = BENCH_THRESHOLD;
+  FILE *fd = stdout;
+  size_t count = 0;
+  int first = argc;
+
+  for (int i = 1; i < argc; ++i)
+    if (strcmp (argv[i], "-o") == 0 && i + 1 < argc)
+      {
+        if ((fd = fopen (argv[++i], "w")) == NULL)
+          {
+            perror (argv[i]);
+            return EXIT_FAILURE;
+          }
+      }
+    else if (strcmp (argv[i], "-c") == 0 && i + 1 < argc)
+      baseline = argv[++i];
+    else if (strcmp (argv[i], "-t") == 0 && i + 1 < argc)
+      threshold = atof (argv[++i]);
+    else if (argv[i][0] == '-')
+      usage (argv[0]);
+    else
+      {
+        first = i;
+        break;
+      }
+
+  for (size_t i = 0; i < total; ++i)
+    {
+      bool selected = first == argc;
+
+      for (int j = first; j < argc; ++j)
+        selected |= strcmp (argv[j], BENCHMARKS[i].name) == 0;
+
+      if (selected)
+        count += bench_run (&BENCHMARKS[i], fd, &results[count]);
+    }
+
+  if (fd != stdout)
+    fclose (fd);
+
+  bool regressed = baseline != NULL
+                   && bench_compare (baseline, results, count, threshold);
+
+  intern_destroy ();
+  shape_destroy_all ();
+
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+// Lexer throughput benchmark: tokenizes a file (or a generated program) with
+// every scanner this CPU supports and reports MB/s.
+//
+//   make build/lexer-bench
+//   build/lexer-bench [file] [repeat]
+
+#include "arena.h"
+#include "intern.h"
+#include "lexer.h"
+#include "scan.h"
+#include "source.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SIZE (16 * 1024 * 1024)
+
+static char *
+bench_generate (size_t *length)
+{
+  static const char *const LINES[] = {
+    "-- a comment that the lexer skips in one run of the scanner\n",
+    "value = (+ (* counter 12) 3.25)\n",
+    "name   =   \"a string literal with some words in it\"\n",
+    "\t\tpoint = { x = 1 y = 2 label = 'origin }\n",
+    "items = [ first-item second-item third-item 1024 ]\n",
+    "    (print (length items) (if (< a b) 'less 'more))\n",
+    "\n"
+  };
+  size_t count = sizeof (LINES) / sizeof (LINES[0]);
+  char *buffer = malloc (BENCH_SIZE);
+
+  *length = 0;
+
+  for (size_t i = 0;; ++i)
+    {
+      const char *line = LINES[i % count];
+      size_t n = strlen (line);
+
+      if (*length + n > BENCH_SIZE)
+        break;
+
+      memcpy (&buffer[*length], line, n);
+      *length += n;
+    }
+
+  return buffer;
+}
+
+static double
+bench_seconds (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct source *source = NULL;
+  char *buffer;
+  size_t length;
+  int repeat = argc > 2 ? atoi (argv[2]) : 5;
+
+  if (argc > 1)
+    {
+      if ((source = source_open (argv[1])) == NULL)
+        return EXIT_FAILURE;
+
+      buffer = source->buffer;
+      length = source->length;
+    }
+  else
+    buffer = bench_generate (&length);
+
+  for (const struct scanner *const *s = scanner_available (); *s; ++s)
+    {
+      double best = 0;
+      size_t tokens = 0;
+
+      scanner_select ((*s)->name);
+
+      for (int i = 0; i < repeat; ++i)
+        {
+          struct arena *arena = arena_create (ARENA_BLOCK_SIZE);
+          struct lexer *lexer = lexer_create (buffer, length, arena, true);
+          double start = bench_seconds ();
+
+          tokens = 0;
+          while (lexer_next (lexer).type != TOKEN_EOF)
+            tokens++;
+
+          double elapsed = bench_seconds () - start;
+
+          if (i == 0 || elapsed < best)
+            best = elapsed;
+
+          lexer_destroy (lexer);
+          arena_destroy (arena);
+        }
+
+      printf ("%-8s %10zu bytes %9zu tokens %8.1f MB/s\n", (*s)->name,
+              length, tokens, length / best / 1e6);
+    }
+
+  if (source != NULL)
+    source_close (source);
+  else
+    free (buffer);
+
+  intern_destroy ();
+
+  return EXIT_SUCCESS;
+}
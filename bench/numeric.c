@@ -0,0 +1,253 @@
+// Numeric kernel benchmark: runs every kernel with each implementation this
+// CPU supports over vector-sized runs of generated items, reports millions
+// of items per second, and fails when an implementation's results differ
+// from the scalar one's.
+//
+//   make build/numeric-bench
+//   build/numeric-bench [repeat]
+
+#include "numeric.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_ITEMS (1 << 18)
+#define BENCH_RUN 32
+
+// Floats are small multiples of 0.5, so that sums over a run are exact in
+// any order and every implementation has to agree bit for bit. Unordered
+// is the same data with NaN in some places, for the kernels that skip it.
+static value_t integers[BENCH_ITEMS];
+static value_t floats[BENCH_ITEMS];
+static value_t unordered[BENCH_ITEMS];
+static value_t mixed[BENCH_ITEMS];
+static value_t out[BENCH_ITEMS];
+
+// Each kernel folds its results into a checksum.
+struct kernel
+{
+  const char *name;
+  double (*run) (const struct numeric *numeric);
+};
+
+static double
+bench_checksum (void)
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; ++i)
+    sum += (double)(out[i] >> 32) * (i % 7 + 1);
+
+  return sum;
+}
+
+static double
+bench_tags (const struct numeric *numeric)
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; i += BENCH_RUN)
+    sum += numeric->tags (&mixed[i], BENCH_RUN);
+
+  return sum;
+}
+
+static double
+bench_truthy (const struct numeric *numeric)
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; i += BENCH_RUN)
+    sum += numeric->truthy (&mixed[i], BENCH_RUN);
+
+  return sum;
+}
+
+static double
+bench_sum (const struct numeric *numeric)
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; i += BENCH_RUN)
+    sum += numeric->sum_integers (&integers[i], BENCH_RUN)
+           + numeric->sum_floats (&floats[i], BENCH_RUN);
+
+  return sum;
+}
+
+static double
+bench_dot (const struct numeric *numeric)
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; i += BENCH_RUN)
+    sum += numeric->dot_integers (&integers[i], &integers[i], BENCH_RUN)
+           + numeric->dot_floats (&floats[i], &floats[i], BENCH_RUN);
+
+  return sum;
+}
+
+static double
+bench_range (const struct numeric *numeric)
+{
+  double sum = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; i += BENCH_RUN)
+    {
+      int32_t low = value_as_integer (integers[i]);
+      int32_t high = low;
+      float least = value_as_float (unordered[i]);
+      float most = least;
+
+      numeric->range_integers (&integers[i], BENCH_RUN, &low, &high);
+      numeric->range_floats (&unordered[i], BENCH_RUN, &least, &most);
+      sum += low + 3.0 * high + 5.0 * least + 7.0 * most;
+    }
+
+  return sum;
+}
+
+static double
+bench_combine (const struct numeric *numeric)
+{
+  for (size_t i = 0; i < BENCH_ITEMS; i += 2 * BENCH_RUN)
+    {
+      int operation = i & 2 * BENCH_RUN ? NUMERIC_ADD : NUMERIC_MULTIPLY;
+
+      numeric->combine_integers (&integers[i], &integers[i + 1], BENCH_RUN,
+                                 operation, &out[i]);
+      numeric->combine_floats (&floats[i + BENCH_RUN],
+                               &floats[i + BENCH_RUN - 1], BENCH_RUN,
+                               operation, &out[i + BENCH_RUN]);
+    }
+
+  return bench_checksum ();
+}
+
+static double
+bench_scale (const struct numeric *numeric)
+{
+  for (size_t i = 0; i < BENCH_ITEMS; i += 2 * BENCH_RUN)
+    {
+      numeric->scale_integers (&integers[i], BENCH_RUN, -3, &out[i]);
+      numeric->scale_floats (&floats[i + BENCH_RUN], BENCH_RUN, 1.5,
+                             &out[i + BENCH_RUN]);
+    }
+
+  return bench_checksum ();
+}
+
+static double
+bench_prefix (const struct numeric *numeric)
+{
+  int32_t carry = 0;
+  float total = 0;
+
+  for (size_t i = 0; i < BENCH_ITEMS; i += 2 * BENCH_RUN)
+    {
+      carry = numeric->prefix_integers (&integers[i], BENCH_RUN, carry,
+                                        &out[i]);
+      total = numeric->prefix_floats (&floats[i + BENCH_RUN], BENCH_RUN,
+                                      total, &out[i + BENCH_RUN]);
+    }
+
+  return bench_checksum () + carry + total;
+}
+
+static const struct kernel KERNELS[] = {
+  { "tags", bench_tags },       { "truthy", bench_truthy },
+  { "sum", bench_sum },         { "dot", bench_dot },
+  { "range", bench_range },     { "combine", bench_combine },
+  { "scale", bench_scale },     { "prefix", bench_prefix }
+};
+
+static void
+bench_generate (void)
+{
+  srand (1);
+
+  for (size_t i = 0; i < BENCH_ITEMS; ++i)
+    {
+      int n = rand () % 2001 - 1000;
+
+      integers[i] = value_integer (i % 61 == 0 ? rand () : n);
+      floats[i] = value_float (n % 200 * 0.5f);
+
+      // A run starts from its first item, which must be ordered.
+      unordered[i] = i % BENCH_RUN != 0 && n % 7 == 0 ? value_float (NAN)
+                                                      : floats[i];
+
+      switch (rand () % 5)
+        {
+        case 0:
+          mixed[i] = VALUE_VOID;
+          break;
+        case 1:
+          mixed[i] = value_float (n % 3 == 0 ? -0.0f : n);
+          break;
+        default:
+          mixed[i] = value_integer (n % 4);
+        }
+    }
+}
+
+static double
+bench_seconds (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t count = sizeof (KERNELS) / sizeof (KERNELS[0]);
+  int repeat = argc > 1 ? atoi (argv[1]) : 20;
+  double expected[sizeof (KERNELS) / sizeof (KERNELS[0])];
+  int failed = 0;
+
+  bench_generate ();
+
+  numeric_select ("scalar");
+
+  for (size_t k = 0; k < count; ++k)
+    expected[k] = KERNELS[k].run (numeric_get ());
+
+  for (const struct numeric *const *n = numeric_available (); *n; ++n)
+    {
+      numeric_select ((*n)->name);
+
+      for (size_t k = 0; k < count; ++k)
+        {
+          double best = 0;
+          double result = 0;
+
+          for (int i = 0; i < repeat; ++i)
+            {
+              double start = bench_seconds ();
+
+              result = KERNELS[k].run (numeric_get ());
+
+              double elapsed = bench_seconds () - start;
+
+              if (i == 0 || elapsed < best)
+                best = elapsed;
+            }
+
+          bool same = result == expected[k];
+
+          printf ("%-8s %-8s %8.1f M items/s%s\n", (*n)->name,
+                  KERNELS[k].name, BENCH_ITEMS / best / 1e6,
+                  same ? "" : "  MISMATCH");
+          failed += !same;
+        }
+    }
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGNMENT (_Alignof (max_align_t))
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+static struct arena_block *
+arena_block_create (size_t size, struct arena_block *next)
+{
+  struct arena_block *block;
+
+  // `calloc ()` hands out zeroed blocks, so allocations never need clearing.
+  block = calloc (1, sizeof (struct arena_block) + size);
+  block->next = next;
+  block->size = size;
+
+  return block;
+}
+
+struct arena *
+arena_create (size_t block_size)
+{
+  struct arena *arena;
+
+  arena = calloc (1, sizeof (struct arena));
+  arena->block_size = block_size;
+
+  return arena;
+}
+
+void
+arena_destroy (struct arena *arena)
+{
+  struct arena_block *current = arena->head;
+
+  while (current != NULL)
+    {
+      struct arena_block *previous = current;
+      current = current->next;
+
+      free (previous);
+    }
+
+  free (arena);
+}
+
+void *
+arena_allocate (struct arena *arena, size_t size)
+{
+  struct arena_block *head = arena->head;
+
+  size = ALIGN (size);
+
+  if (head == NULL || head->used + size > head->size)
+    {
+      // Oversized requests get a block of their own behind the current one,
+      // so the partially used head keeps serving small allocations.
+      if (size > arena->block_size / 4 && head != NULL)
+        {
+          head->next = arena_block_create (size, head->next);
+          head->next->used = size;
+          return head->next->data;
+        }
+
+      size_t block_size = size > arena->block_size ? size : arena->block_size;
+
+      head = arena->head = arena_block_create (block_size, head);
+    }
+
+  void *pointer = head->data + head->used;
+  head->used += size;
+
+  return pointer;
+}
+
+char *
+arena_copy_string (struct arena *arena, const char *s, size_t length)
+{
+  char *copy = arena_allocate (arena, length + 1);
+
+  memcpy (copy, s, length);
+
+  return copy;
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct arena_block
+{
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  _Alignas (max_align_t) char data[];
+};
+
+struct arena
+{
+  struct arena_block *head;
+  size_t block_size;
+};
+
+struct arena *arena_create (size_t block_size);
+void arena_destroy (struct arena *arena);
+
+void *arena_allocate (struct arena *arena, size_t size);
+char *arena_copy_string (struct arena *arena, const char *s, size_t length);
+
+#endif // ARENA_H
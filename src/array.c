@@ -39,7 +39,7 @@ void (array_append) (void **array, const void *item)
 
   if (length >= capacity)
     {
-      void *new = array_create (capacity * 2, stride);
+      void *new = array_create (capacity ? capacity * 2 : 1, stride);
 
       memcpy (new, *array, length * stride);
       HEADER_FIELD (new, LENGTH) = length;
@@ -54,6 +54,13 @@ void (array_append) (void **array, const void *item)
   HEADER_FIELD (*array, LENGTH) = length + 1;
 }
 
+void
+array_truncate (void *array, size_t length)
+{
+  if (length < HEADER_FIELD (array, LENGTH))
+    HEADER_FIELD (array, LENGTH) = length;
+}
+
 size_t
 array_length (void *array)
 {
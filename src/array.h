@@ -9,6 +9,7 @@ void *array_create (size_t capacity, size_t stride);
 void array_destroy (void *array);
 
 void (array_append) (void **array, const void *item);
+void array_truncate (void *array, size_t length);
 size_t array_length (void *array);
 size_t array_capacity (void *array);
 size_t array_stride (void *array);
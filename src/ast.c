@@ -1,6 +1,10 @@
 #include "ast.h"
+#include "array.h"
+#include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
 static const char *const TYPES[] = {
   "PROGRAM",
@@ -17,47 +21,273 @@ static const char *const TYPES[] = {
   "SYMBOL"
 };
 
+#define AST_CAPACITY 64
+
+// Grows every node array together, so adding a node is a handful of stores.
+// Large arrays are remapped rather than copied by realloc.
+static void
+ast_grow (struct ast *ast)
+{
+  ast->capacity = ast->capacity ? ast->capacity * 2 : AST_CAPACITY;
+
+  ast->types = realloc (ast->types, ast->capacity * sizeof (uint8_t));
+  ast->lines = realloc (ast->lines, ast->capacity * sizeof (uint32_t));
+  ast->children = realloc (ast->children, ast->capacity * sizeof (node_t));
+  ast->lasts = realloc (ast->lasts, ast->capacity * sizeof (node_t));
+  ast->nexts = realloc (ast->nexts, ast->capacity * sizeof (node_t));
+  ast->payloads = realloc (ast->payloads, ast->capacity * sizeof (uint32_t));
+}
+
+static void
+ast_grow_data (struct ast *ast)
+{
+  ast->data_capacity = ast->data_capacity ? ast->data_capacity * 2
+                                          : AST_CAPACITY;
+  ast->data = realloc (ast->data,
+                       ast->data_capacity * sizeof (struct ast_payload));
+}
+
 struct ast *
-ast_create (size_t type, size_t line)
+ast_create (void)
 {
-  struct ast *node;
+  struct ast *ast;
 
-  node = calloc (1, sizeof (struct ast));
-  node->type = type;
-  node->line = line;
+  ast = calloc (1, sizeof (struct ast));
+  ast->root = AST_NONE;
 
-  return node;
+  ast_grow (ast);
+
+  return ast;
 }
 
 void
-ast_destroy (struct ast *node)
+ast_destroy (struct ast *ast)
+{
+  if (ast->mapping != NULL)
+    munmap (ast->mapping, ast->mapping_size);
+  else
+    {
+      free (ast->types);
+      free (ast->lines);
+      free (ast->children);
+      free (ast->lasts);
+      free (ast->nexts);
+      free (ast->payloads);
+    }
+
+  free (ast->data);
+
+  if (ast->statements != NULL)
+    array_destroy (ast->statements);
+
+  free (ast);
+}
+
+node_t
+ast_add (struct ast *ast, size_t type, size_t line)
+{
+  node_t node = ast->length;
+
+  if (node == AST_NONE)
+    error (line, "too many syntax tree nodes");
+
+  if (ast->length == ast->capacity)
+    ast_grow (ast);
+
+  ast->types[node] = type;
+  ast->lines[node] = line;
+  ast->children[node] = AST_NONE;
+  ast->lasts[node] = AST_NONE;
+  ast->nexts[node] = AST_NONE;
+  ast->payloads[node] = AST_NONE;
+  ast->length++;
+
+  return node;
+}
+
+// Payloads start out zeroed; pointers into the table only stay valid until
+// the next payload is added.
+struct ast_payload *
+ast_add_payload (struct ast *ast, node_t node)
 {
-  if (node->child != NULL)
-    ast_destroy (node->child);
+  if (ast->data_length == ast->data_capacity)
+    ast_grow_data (ast);
 
-  if (node->next != NULL)
-    ast_destroy (node->next);
+  ast->payloads[node] = ast->data_length;
+  ast->data[ast->data_length] = (struct ast_payload){ 0 };
 
-  if (node->token.value != NULL)
-    token_destroy (node->token);
+  return &ast->data[ast->data_length++];
+}
+
+struct ast_payload *
+ast_payload (struct ast *ast, node_t node)
+{
+  if (ast->payloads[node] == AST_NONE)
+    return NULL;
 
-  free (node);
+  return &ast->data[ast->payloads[node]];
 }
 
 void
-ast_append (struct ast *node, struct ast *child)
+ast_append (struct ast *ast, node_t node, node_t child)
 {
-  if (node->child == NULL)
-    node->child = child;
+  if (ast->children[node] == AST_NONE)
+    ast->children[node] = child;
   else
+    ast->nexts[ast->lasts[node]] = child;
+
+  ast->lasts[node] = child;
+}
+
+static node_t
+ast_shift (node_t node, ptrdiff_t delta)
+{
+  return node == AST_NONE ? AST_NONE : node + delta;
+}
+
+// Moves the `count` indices from `from` on by `distance` items, and adds
+// `delta` to them. Copying first and adjusting after keeps both loops
+// simple enough to vectorize.
+static void
+ast_move (uint32_t *indices, size_t from, ptrdiff_t distance, size_t count,
+          ptrdiff_t delta)
+{
+  uint32_t *moved = indices + from + distance;
+
+  memmove (moved, indices + from, count * sizeof (uint32_t));
+
+  if (delta != 0)
+    for (size_t i = 0; i < count; ++i)
+      moved[i] = ast_shift (moved[i], delta);
+}
+
+// Replaces top-level statements `first` up to `end` with the statements of
+// `replacement`, a program parsed on its own from where statement `first`
+// starts, and moves those after them `bytes` bytes and `lines` lines on.
+// Nodes and payloads end up numbered as if the whole program was parsed at
+// once. Only the arrays past the replaced statements are moved.
+void
+ast_splice (struct ast *ast, size_t first, size_t end,
+            struct ast *replacement, ptrdiff_t bytes, ptrdiff_t lines)
+{
+  struct ast_statement *statements = ast->statements;
+  struct ast_statement *added = replacement->statements;
+  size_t count = array_length (statements);
+  size_t length = array_length (added);
+  node_t from = first < count ? statements[first].first : ast->length;
+  node_t to = end < count ? statements[end].first : ast->length;
+  uint32_t data_from = first < count ? statements[first].payload
+                                     : ast->data_length;
+  uint32_t data_to = end < count ? statements[end].payload : ast->data_length;
+
+  // The replacement's own root is left out.
+  ptrdiff_t nodes = (ptrdiff_t)(replacement->length - 1) - (to - from);
+  ptrdiff_t data = (ptrdiff_t)replacement->data_length - (data_to - data_from);
+  size_t tail = ast->length - to;
+  size_t data_tail = ast->data_length - data_to;
+
+  if (ast->length + nodes >= AST_NONE)
+    error (replacement->lines[replacement->length - 1],
+           "too many syntax tree nodes");
+
+  while (ast->length + nodes > ast->capacity)
+    ast_grow (ast);
+
+  while (ast->data_length + data > ast->data_capacity)
+    ast_grow_data (ast);
+
+  if (nodes != 0)
+    {
+      memmove (ast->types + to + nodes, ast->types + to,
+               tail * sizeof (uint8_t));
+      memmove (ast->lines + to + nodes, ast->lines + to,
+               tail * sizeof (uint32_t));
+      ast_move (ast->children, to, nodes, tail, nodes);
+      ast_move (ast->lasts, to, nodes, tail, nodes);
+      ast_move (ast->nexts, to, nodes, tail, nodes);
+    }
+
+  if (nodes != 0 || data != 0)
+    ast_move (ast->payloads, to, nodes, tail, data);
+
+  if (lines != 0)
+    for (size_t i = to + nodes; i < to + nodes + tail; ++i)
+      ast->lines[i] += lines;
+
+  memmove (ast->data + data_to + data, ast->data + data_to,
+           data_tail * sizeof (struct ast_payload));
+
+  for (size_t j = 1; j < replacement->length; ++j)
     {
-      struct ast *current;
+      size_t i = from + j - 1;
 
-      current = node->child;
-      while (current->next != NULL)
-        current = current->next;
-      current->next = child;
+      ast->types[i] = replacement->types[j];
+      ast->lines[i] = replacement->lines[j];
+      ast->children[i] = ast_shift (replacement->children[j], from - 1);
+      ast->lasts[i] = ast_shift (replacement->lasts[j], from - 1);
+      ast->nexts[i] = ast_shift (replacement->nexts[j], from - 1);
+      ast->payloads[i] = ast_shift (replacement->payloads[j], data_from);
     }
+
+  memcpy (ast->data + data_from, replacement->data,
+          replacement->data_length * sizeof (struct ast_payload));
+
+  ast->length += nodes;
+  ast->data_length += data;
+
+  struct ast_statement *result
+      = array_create (count - (end - first) + length,
+                      sizeof (struct ast_statement));
+
+  for (size_t i = 0; i < first; ++i)
+    array_append (result, &statements[i]);
+
+  for (size_t i = 0; i < length; ++i)
+    {
+      struct ast_statement statement = added[i];
+
+      statement.node += from - 1;
+      statement.first += from - 1;
+      statement.payload += data_from;
+      array_append (result, &statement);
+    }
+
+  for (size_t i = end; i < count; ++i)
+    {
+      struct ast_statement statement = statements[i];
+
+      statement.offset += bytes;
+      statement.line += lines;
+      statement.node += nodes;
+      statement.first += nodes;
+      statement.payload += data;
+      array_append (result, &statement);
+    }
+
+  array_destroy (statements);
+  ast->statements = result;
+
+  // Link the root's statements across both seams.
+  size_t total = array_length (result);
+  node_t root = ast->root;
+
+  if (first == 0)
+    ast->children[root] = total > 0 ? result[0].node : AST_NONE;
+  else
+    ast->nexts[result[first - 1].node]
+        = first < total ? result[first].node : AST_NONE;
+
+  if (length > 0)
+    ast->nexts[result[first + length - 1].node]
+        = first + length < total ? result[first + length].node : AST_NONE;
+
+  ast->lasts[root] = total > 0 ? result[total - 1].node : AST_NONE;
+}
+
+size_t
+ast_count (struct ast *ast)
+{
+  return ast->length;
 }
 
 const char *
@@ -66,27 +296,26 @@ ast_type_string (size_t type)
   return TYPES[type];
 }
 
+// Prints `node` and the siblings that follow it. Only nesting recurses, so
+// long child lists cannot overflow the C stack.
 void
-ast_print_debug (struct ast *node, size_t depth)
+ast_print_debug (struct ast *ast, node_t node, size_t depth)
 {
-  if (node == NULL)
-    return;
-
-  for (size_t i = depth * 4; i--;)
-    printf (" ");
+  for (; node != AST_NONE; node = ast->nexts[node])
+    {
+      struct ast_payload *payload = ast_payload (ast, node);
 
-  printf ("%s:", ast_type_string (node->type));
+      for (size_t i = depth * 4; i--;)
+        printf (" ");
 
-  if (node->token.value)
-    printf (" `%s`", node->token.value);
+      printf ("%s:", ast_type_string (ast->types[node]));
 
-  printf (" (line %zu)", node->line);
-  printf ("\n");
+      if (payload != NULL && payload->text)
+        printf (" `%.*s`", (int)payload->length, payload->text);
 
-  if (node->child != NULL)
-    ast_print_debug (node->child, depth + 1);
+      printf (" (line %u)", ast->lines[node]);
+      printf ("\n");
 
-  if (node->next != NULL)
-    ast_print_debug (node->next, depth);
+      ast_print_debug (ast, ast->children[node], depth + 1);
+    }
 }
-
@@ -1,7 +1,8 @@
 #ifndef AST_H
 #define AST_H
 
-#include "token.h"
+#include <stddef.h>
+#include <stdint.h>
 
 enum
 {
@@ -22,22 +23,100 @@ enum
   AST_SYMBOL
 };
 
+// Nodes are indices into the arrays of a `struct ast`.
+typedef uint32_t node_t;
+
+#define AST_NONE ((node_t)-1)
+#define AST_GLOBAL ((uint32_t)-1)
+
+struct scope;
+
+// Literals, identifiers and symbols keep their token's interned `text` and
+// decoded value. Declarations and function definitions get an empty payload.
+//
+// Set by `resolve ()`: identifiers and declarations refer to `slot` of the
+// function definition `depth` levels out, or to a global when `depth` is
+// AST_GLOBAL. Function definitions point to their `scope`.
+struct ast_payload
+{
+  const char *text;
+  uint32_t length;
+
+  union
+  {
+    int32_t integer;
+    float floating;
+  } as;
+
+  union
+  {
+    struct
+    {
+      uint32_t depth;
+      uint32_t slot;
+    };
+
+    struct scope *scope;
+  };
+};
+
+// Where a top-level statement starts in the source, and the nodes and
+// payloads parsed for it: those from `first` and `payload` up to the next
+// statement's, with `node` the statement itself.
+struct ast_statement
+{
+  size_t offset;
+  uint32_t line;
+  node_t node;
+  node_t first;
+  uint32_t payload;
+};
+
+// A syntax tree stored as parallel arrays of `capacity` items, of which the
+// first `length` are nodes. Children form a list through `nexts`, starting
+// at `children` and ending at `lasts`; AST_NONE ends lists. Nodes that need
+// a payload have the index of theirs in `data` in `payloads`, and AST_NONE
+// otherwise. The parser lists the top-level `statements` in order.
+//
+// A tree loaded from a cache (see cache.h) keeps its node arrays in the
+// file's `mapping` instead; it has no `lasts` or `statements` and cannot
+// grow.
 struct ast
 {
-  struct token token;
-  struct ast *child;
-  struct ast *next;
-  size_t type;
-  size_t line;
+  size_t length;
+  size_t capacity;
+
+  uint8_t *types;
+  uint32_t *lines;
+  node_t *children;
+  node_t *lasts;
+  node_t *nexts;
+  uint32_t *payloads;
+
+  struct ast_payload *data;
+  size_t data_length;
+  size_t data_capacity;
+
+  node_t root;
+  struct ast_statement *statements;
+
+  void *mapping;
+  size_t mapping_size;
 };
 
-struct ast *ast_create (size_t type, size_t line);
-void ast_destroy (struct ast *node);
+struct ast *ast_create (void);
+void ast_destroy (struct ast *ast);
 
-void ast_append (struct ast *node, struct ast *child);
+node_t ast_add (struct ast *ast, size_t type, size_t line);
+struct ast_payload *ast_add_payload (struct ast *ast, node_t node);
+struct ast_payload *ast_payload (struct ast *ast, node_t node);
+
+void ast_append (struct ast *ast, node_t node, node_t child);
+void ast_splice (struct ast *ast, size_t first, size_t end,
+                 struct ast *replacement, ptrdiff_t bytes, ptrdiff_t lines);
+size_t ast_count (struct ast *ast);
 const char *ast_type_string (size_t type);
 
-void ast_print_debug (struct ast *node, size_t depth);
+void ast_print_debug (struct ast *ast, node_t node, size_t depth);
 
 #endif // AST_H
-
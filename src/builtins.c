@@ -0,0 +1,712 @@
+#include "builtins.h"
+#include "common.h"
+#include "intern.h"
+#include "numeric.h"
+#include "vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define IS_NUMBER(value)                                                      \
+  (VALUE_TAG (value) == TAG_INTEGER || VALUE_TAG (value) == TAG_FLOAT)
+#define AS_FLOAT(value)                                                       \
+  (VALUE_TAG (value) == TAG_INTEGER ? (float)value_as_integer (value)        \
+                                    : value_as_float (value))
+#define AS_DOUBLE(value)                                                      \
+  (VALUE_TAG (value) == TAG_INTEGER ? (double)value_as_integer (value)       \
+                                    : (double)value_as_float (value))
+#define TYPE_NAME(value) value_type_string (value_type (value))
+
+// What `builtin_compare ()` returns when either number is NaN.
+#define UNORDERED 2
+
+static bool
+value_truthy (value_t value)
+{
+  switch (VALUE_TAG (value))
+    {
+    case TAG_INTEGER:
+      return value_as_integer (value) != 0;
+    case TAG_FLOAT:
+      return value_as_float (value) != 0;
+    case TAG_VOID:
+      return false;
+    default:
+      return true;
+    }
+}
+
+// Orders two numbers as -1, 0 or 1. Integers compare as integers, which
+// floats cannot always hold; other pairs are widened to double, which holds
+// both exactly.
+static int
+builtin_compare (value_t a, value_t b)
+{
+  if (VALUE_TAG (a) == TAG_INTEGER && VALUE_TAG (b) == TAG_INTEGER)
+    {
+      int32_t x = value_as_integer (a);
+      int32_t y = value_as_integer (b);
+
+      return (x > y) - (x < y);
+    }
+
+  double x = AS_DOUBLE (a);
+  double y = AS_DOUBLE (b);
+
+  return x < y ? -1 : x > y ? 1 : x == y ? 0 : UNORDERED;
+}
+
+static bool
+value_equal (value_t a, value_t b)
+{
+  if (IS_NUMBER (a) && IS_NUMBER (b))
+    return builtin_compare (a, b) == 0;
+
+  if (a == b)
+    return true;
+
+  if (!VALUE_IS_OBJECT (a) || !VALUE_IS_OBJECT (b))
+    return false;
+
+  struct value *x = value_as_object (a);
+  struct value *y = value_as_object (b);
+
+  return x->type == TYPE_STRING && y->type == TYPE_STRING
+         && strcmp (x->p, y->p) == 0;
+}
+
+static void
+builtin_expect_numbers (const char *name, value_t *argv, size_t line)
+{
+  if (!IS_NUMBER (argv[0]) || !IS_NUMBER (argv[1]))
+    error (line, "`%s` expects numbers, got %s and %s", name,
+           TYPE_NAME (argv[0]), TYPE_NAME (argv[1]));
+}
+
+static value_t
+builtin_arithmetic (value_t *argv, size_t line, const char *name)
+{
+  value_t a = argv[0];
+  value_t b = argv[1];
+
+  builtin_expect_numbers (name, argv, line);
+
+  if (VALUE_TAG (a) == TAG_INTEGER && VALUE_TAG (b) == TAG_INTEGER)
+    {
+      int32_t x = value_as_integer (a);
+      int32_t y = value_as_integer (b);
+
+      // Integers wrap around, as in the numeric kernels: the arithmetic is
+      // done on uint32_t, and INT32_MIN / -1 is INT32_MIN.
+      switch (*name)
+        {
+        case '+':
+          return value_integer ((int32_t)((uint32_t)x + (uint32_t)y));
+        case '-':
+          return value_integer ((int32_t)((uint32_t)x - (uint32_t)y));
+        case '*':
+          return value_integer ((int32_t)((uint32_t)x * (uint32_t)y));
+        default:
+          if (y == 0)
+            error (line, "division by zero");
+          if (y == -1)
+            return value_integer (*name == '/' ? (int32_t)(0u - (uint32_t)x)
+                                               : 0);
+          return value_integer (*name == '/' ? x / y : x % y);
+        }
+    }
+
+  if (*name == '%')
+    error (line, "`%%` expects integers");
+
+  switch (*name)
+    {
+    case '+':
+      return value_float (AS_FLOAT (a) + AS_FLOAT (b));
+    case '-':
+      return value_float (AS_FLOAT (a) - AS_FLOAT (b));
+    case '*':
+      return value_float (AS_FLOAT (a) * AS_FLOAT (b));
+    default:
+      return value_float (AS_FLOAT (a) / AS_FLOAT (b));
+    }
+}
+
+static value_t
+builtin_add (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_arithmetic (argv, line, "+");
+}
+
+static value_t
+builtin_subtract (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_arithmetic (argv, line, "-");
+}
+
+static value_t
+builtin_multiply (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_arithmetic (argv, line, "*");
+}
+
+static value_t
+builtin_divide (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_arithmetic (argv, line, "/");
+}
+
+static value_t
+builtin_modulo (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_arithmetic (argv, line, "%");
+}
+
+static value_t
+builtin_less (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  builtin_expect_numbers ("<", argv, line);
+  return value_integer (builtin_compare (argv[0], argv[1]) == -1);
+}
+
+static value_t
+builtin_greater (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  builtin_expect_numbers (">", argv, line);
+  return value_integer (builtin_compare (argv[0], argv[1]) == 1);
+}
+
+static value_t
+builtin_eq (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc, (void)line;
+  return value_integer (value_equal (argv[0], argv[1]));
+}
+
+static value_t
+builtin_not (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc, (void)line;
+  return value_integer (!value_truthy (argv[0]));
+}
+
+static value_t
+builtin_if (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc, (void)line;
+  return value_truthy (argv[0]) ? argv[1] : argv[2];
+}
+
+static value_t
+builtin_length (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+
+  switch (value_type (argv[0]))
+    {
+    case TYPE_STRING:
+      return value_integer (strlen (value_as_object (argv[0])->p));
+    case TYPE_ARRAY:
+      {
+        struct vector *vector = value_as_object (argv[0])->p;
+
+        return value_integer (vector->length);
+      }
+    default:
+      error (line, "`length` expects STRING or ARRAY, got %s",
+             TYPE_NAME (argv[0]));
+    }
+}
+
+static struct vector *
+builtin_expect_array (const char *name, value_t value, size_t line)
+{
+  if (value_type (value) != TYPE_ARRAY)
+    error (line, "`%s` expects ARRAY, got %s", name, TYPE_NAME (value));
+
+  return value_as_object (value)->p;
+}
+
+static size_t
+builtin_expect_index (const char *name, value_t value, size_t length,
+                      size_t line)
+{
+  if (VALUE_TAG (value) != TAG_INTEGER)
+    error (line, "`%s` expects INTEGER index, got %s", name,
+           TYPE_NAME (value));
+
+  int i = value_as_integer (value);
+
+  if (i < 0 || (size_t)i > length)
+    error (line, "`%s` index %i out of range", name, i);
+
+  return i;
+}
+
+// Arrays are persistent: these return a new array, which shares all but
+// O(log n) of its memory with the old one.
+static value_t
+builtin_push (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  struct vector *vector = builtin_expect_array ("push", argv[0], line);
+
+  (void)argc;
+
+  vector = vector_copy (vm->pool, vector);
+  vector_push (vector, argv[1]);
+
+  return vm_array (vm, vector);
+}
+
+static value_t
+builtin_set (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  struct vector *vector = builtin_expect_array ("set", argv[0], line);
+  size_t index = builtin_expect_index ("set", argv[1], vector->length, line);
+
+  (void)argc;
+
+  if (index == vector->length)
+    error (line, "`set` index %zu out of range", index);
+
+  vector = vector_copy (vm->pool, vector);
+  vector_set (vector, index, argv[2]);
+
+  return vm_array (vm, vector);
+}
+
+static value_t
+builtin_slice (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  struct vector *vector = builtin_expect_array ("slice", argv[0], line);
+  size_t start = builtin_expect_index ("slice", argv[1], vector->length, line);
+  size_t end = builtin_expect_index ("slice", argv[2], vector->length, line);
+
+  (void)argc;
+
+  if (start > end)
+    error (line, "`slice` start %zu is after end %zu", start, end);
+
+  vector = vector_copy (vm->pool, vector);
+  vector_slice (vector, start, end);
+
+  return vm_array (vm, vector);
+}
+
+// The numeric builtins hand each leaf of their arrays to a kernel (see
+// numeric.h) when it holds only integers or only floats. Leaves that mix
+// them go an item at a time, with the same results as `+` and `*`. Chunks
+// are combined with `builtin_arithmetic ()` as well, so only a float makes
+// a result a float, and integers wrap around across leaves just as they do
+// within one.
+
+static unsigned
+builtin_expect_chunk (const char *name, const value_t *items, size_t n,
+                      size_t line)
+{
+  unsigned tags = numeric_get ()->tags (items, n);
+
+  if (tags & ~NUMERIC_NUMBERS)
+    for (size_t i = 0; i < n; ++i)
+      if (!IS_NUMBER (items[i]))
+        error (line, "`%s` expects numbers, got %s", name,
+               TYPE_NAME (items[i]));
+
+  return tags;
+}
+
+// Checks every item before a new array is built, which an error would
+// leak.
+static void
+builtin_expect_numeric (const char *name, struct vector *vector,
+                        size_t line)
+{
+  for (size_t i = 0, n; i < vector->length; i += n)
+    {
+      const value_t *items = vector_chunk (vector, i, &n);
+
+      builtin_expect_chunk (name, items, n, line);
+    }
+}
+
+static void
+builtin_expect_lengths (const char *name, struct vector *a,
+                        struct vector *b, size_t line)
+{
+  if (a->length != b->length)
+    error (line, "`%s` expects arrays of the same length, got %zu and %zu",
+           name, a->length, b->length);
+}
+
+static value_t
+builtin_combine (value_t a, value_t b, size_t line, const char *operation)
+{
+  value_t argv[2] = { a, b };
+
+  return builtin_arithmetic (argv, line, operation);
+}
+
+static value_t
+builtin_sum (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *vector = builtin_expect_array ("sum", argv[0], line);
+  value_t sum = value_integer (0);
+
+  (void)vm, (void)argc;
+
+  for (size_t i = 0, n; i < vector->length; i += n)
+    {
+      const value_t *items = vector_chunk (vector, i, &n);
+      unsigned tags = builtin_expect_chunk ("sum", items, n, line);
+
+      if (tags == NUMERIC_INTEGERS)
+        sum = builtin_combine (
+            sum, value_integer (numeric->sum_integers (items, n)), line, "+");
+      else if (tags == NUMERIC_FLOATS)
+        sum = builtin_combine (
+            sum, value_float (numeric->sum_floats (items, n)), line, "+");
+      else
+        for (size_t j = 0; j < n; ++j)
+          sum = builtin_combine (sum, items[j], line, "+");
+    }
+
+  return sum;
+}
+
+static value_t
+builtin_range (value_t *argv, size_t line, const char *name, bool maximum)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *vector = builtin_expect_array (name, argv[0], line);
+  value_t result = VALUE_NONE;
+
+  if (vector->length == 0)
+    error (line, "`%s` expects a non-empty ARRAY", name);
+
+  for (size_t i = 0, n; i < vector->length; i += n)
+    {
+      const value_t *items = vector_chunk (vector, i, &n);
+      unsigned tags = builtin_expect_chunk (name, items, n, line);
+      value_t candidate;
+
+      if (tags == NUMERIC_INTEGERS)
+        {
+          int32_t min = value_as_integer (items[0]);
+          int32_t max = min;
+
+          numeric->range_integers (items, n, &min, &max);
+          candidate = value_integer (maximum ? max : min);
+        }
+      else if (tags == NUMERIC_FLOATS)
+        {
+          float min = value_as_float (items[0]);
+          float max = min;
+
+          numeric->range_floats (items, n, &min, &max);
+          candidate = value_float (maximum ? max : min);
+        }
+      else
+        {
+          candidate = items[0];
+
+          for (size_t j = 1; j < n; ++j)
+            if (builtin_compare (items[j], candidate) == (maximum ? 1 : -1))
+              candidate = items[j];
+        }
+
+      if (result == VALUE_NONE
+          || builtin_compare (candidate, result) == (maximum ? 1 : -1))
+        result = candidate;
+    }
+
+  return result;
+}
+
+static value_t
+builtin_min (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_range (argv, line, "min", false);
+}
+
+static value_t
+builtin_max (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)argc;
+  return builtin_range (argv, line, "max", true);
+}
+
+static value_t
+builtin_dot (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *a = builtin_expect_array ("dot", argv[0], line);
+  struct vector *b = builtin_expect_array ("dot", argv[1], line);
+  value_t sum = value_integer (0);
+
+  (void)vm, (void)argc;
+  builtin_expect_lengths ("dot", a, b, line);
+
+  for (size_t i = 0, n; i < a->length; i += n)
+    {
+      size_t m;
+      const value_t *x = vector_chunk (a, i, &n);
+      const value_t *y = vector_chunk (b, i, &m);
+
+      n = m < n ? m : n;
+
+      unsigned tags = builtin_expect_chunk ("dot", x, n, line)
+                      | builtin_expect_chunk ("dot", y, n, line) << 8;
+
+      if (tags == (NUMERIC_INTEGERS | NUMERIC_INTEGERS << 8))
+        sum = builtin_combine (
+            sum, value_integer (numeric->dot_integers (x, y, n)), line, "+");
+      else if (tags == (NUMERIC_FLOATS | NUMERIC_FLOATS << 8))
+        sum = builtin_combine (
+            sum, value_float (numeric->dot_floats (x, y, n)), line, "+");
+      else
+        for (size_t j = 0; j < n; ++j)
+          sum = builtin_combine (sum, builtin_combine (x[j], y[j], line, "*"),
+                                 line, "+");
+    }
+
+  return sum;
+}
+
+// `add` and `mul` work item by item on two arrays of the same length.
+static value_t
+builtin_elementwise (struct vm *vm, value_t *argv, size_t line,
+                     const char *name, int operation)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *a = builtin_expect_array (name, argv[0], line);
+  struct vector *b = builtin_expect_array (name, argv[1], line);
+  struct vector *vector;
+  value_t out[VECTOR_WIDTH];
+
+  builtin_expect_lengths (name, a, b, line);
+  builtin_expect_numeric (name, a, line);
+  builtin_expect_numeric (name, b, line);
+
+  vector = vector_create (vm->pool);
+  vector_transient (vector);
+
+  for (size_t i = 0, n; i < a->length; i += n)
+    {
+      size_t m;
+      const value_t *x = vector_chunk (a, i, &n);
+      const value_t *y = vector_chunk (b, i, &m);
+
+      n = m < n ? m : n;
+
+      unsigned tags = numeric->tags (x, n) | numeric->tags (y, n) << 8;
+
+      if (tags == (NUMERIC_INTEGERS | NUMERIC_INTEGERS << 8))
+        numeric->combine_integers (x, y, n, operation, out);
+      else if (tags == (NUMERIC_FLOATS | NUMERIC_FLOATS << 8))
+        numeric->combine_floats (x, y, n, operation, out);
+      else
+        for (size_t j = 0; j < n; ++j)
+          out[j] = builtin_combine (x[j], y[j], line,
+                                    operation == NUMERIC_ADD ? "+" : "*");
+
+      vector_push_items (vector, out, n);
+    }
+
+  vector_persist (vector);
+
+  return vm_array (vm, vector);
+}
+
+static value_t
+builtin_add_arrays (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)argc;
+  return builtin_elementwise (vm, argv, line, "add", NUMERIC_ADD);
+}
+
+static value_t
+builtin_multiply_arrays (struct vm *vm, size_t argc, value_t *argv,
+                         size_t line)
+{
+  (void)argc;
+  return builtin_elementwise (vm, argv, line, "mul", NUMERIC_MULTIPLY);
+}
+
+static value_t
+builtin_scale (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *vector = builtin_expect_array ("scale", argv[0], line);
+  value_t factor = argv[1];
+  struct vector *result;
+  value_t out[VECTOR_WIDTH];
+
+  (void)argc;
+
+  if (!IS_NUMBER (factor))
+    error (line, "`scale` expects a number, got %s", TYPE_NAME (factor));
+
+  builtin_expect_numeric ("scale", vector, line);
+
+  result = vector_create (vm->pool);
+  vector_transient (result);
+
+  for (size_t i = 0, n; i < vector->length; i += n)
+    {
+      const value_t *items = vector_chunk (vector, i, &n);
+      unsigned tags = numeric->tags (items, n);
+
+      if (tags == NUMERIC_INTEGERS && VALUE_TAG (factor) == TAG_INTEGER)
+        numeric->scale_integers (items, n, value_as_integer (factor), out);
+      else if (tags == NUMERIC_FLOATS)
+        numeric->scale_floats (items, n, AS_FLOAT (factor), out);
+      else
+        for (size_t j = 0; j < n; ++j)
+          out[j] = builtin_combine (items[j], factor, line, "*");
+
+      vector_push_items (result, out, n);
+    }
+
+  vector_persist (result);
+
+  return vm_array (vm, result);
+}
+
+// Runs the sum in integers until the first float.
+static value_t
+builtin_prefix_sum (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *vector = builtin_expect_array ("prefix-sum", argv[0], line);
+  value_t sum = value_integer (0);
+  struct vector *result;
+  value_t out[VECTOR_WIDTH];
+
+  (void)argc;
+  builtin_expect_numeric ("prefix-sum", vector, line);
+
+  result = vector_create (vm->pool);
+  vector_transient (result);
+
+  for (size_t i = 0, n; i < vector->length; i += n)
+    {
+      const value_t *items = vector_chunk (vector, i, &n);
+      unsigned tags = numeric->tags (items, n);
+
+      if (tags == NUMERIC_INTEGERS && VALUE_TAG (sum) == TAG_INTEGER)
+        sum = value_integer (numeric->prefix_integers (
+            items, n, value_as_integer (sum), out));
+      else if (tags == NUMERIC_FLOATS)
+        sum = value_float (
+            numeric->prefix_floats (items, n, AS_FLOAT (sum), out));
+      else
+        for (size_t j = 0; j < n; ++j)
+          out[j] = sum = builtin_combine (sum, items[j], line, "+");
+
+      vector_push_items (result, out, n);
+    }
+
+  vector_persist (result);
+
+  return vm_array (vm, result);
+}
+
+// Keeps the items whose counterpart in the mask is true.
+static value_t
+builtin_filter (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  const struct numeric *numeric = numeric_get ();
+  struct vector *vector = builtin_expect_array ("filter", argv[0], line);
+  struct vector *mask = builtin_expect_array ("filter", argv[1], line);
+  struct vector *result;
+  value_t out[VECTOR_WIDTH];
+
+  (void)argc;
+  builtin_expect_lengths ("filter", vector, mask, line);
+
+  result = vector_create (vm->pool);
+  vector_transient (result);
+
+  for (size_t i = 0, n; i < vector->length; i += n)
+    {
+      size_t m, count = 0;
+      const value_t *items = vector_chunk (vector, i, &n);
+      const value_t *flags = vector_chunk (mask, i, &m);
+
+      n = m < n ? m : n;
+
+      for (uint32_t bits = numeric->truthy (flags, n); bits != 0;
+           bits &= bits - 1)
+        out[count++] = items[__builtin_ctz (bits)];
+
+      vector_push_items (result, out, count);
+    }
+
+  vector_persist (result);
+
+  return vm_array (vm, result);
+}
+
+static value_t
+builtin_print (struct vm *vm, size_t argc, value_t *argv, size_t line)
+{
+  (void)vm, (void)line;
+
+  for (size_t i = 0; i < argc; ++i)
+    {
+      if (i > 0)
+        printf (" ");
+      value_print (argv[i], stdout);
+    }
+
+  printf ("\n");
+
+  return VALUE_VOID;
+}
+
+static const struct native BUILTINS[] = {
+  { "+", 2, builtin_add },
+  { "-", 2, builtin_subtract },
+  { "*", 2, builtin_multiply },
+  { "/", 2, builtin_divide },
+  { "%", 2, builtin_modulo },
+  { "<", 2, builtin_less },
+  { ">", 2, builtin_greater },
+  { "eq", 2, builtin_eq },
+  { "not", 1, builtin_not },
+  { "if", 3, builtin_if },
+  { "length", 1, builtin_length },
+  { "push", 2, builtin_push },
+  { "set", 3, builtin_set },
+  { "slice", 3, builtin_slice },
+  { "sum", 1, builtin_sum },
+  { "min", 1, builtin_min },
+  { "max", 1, builtin_max },
+  { "dot", 2, builtin_dot },
+  { "add", 2, builtin_add_arrays },
+  { "mul", 2, builtin_multiply_arrays },
+  { "scale", 2, builtin_scale },
+  { "prefix-sum", 1, builtin_prefix_sum },
+  { "filter", 2, builtin_filter },
+  { "print", NATIVE_VARIADIC, builtin_print }
+};
+
+void
+builtins_register (struct vm *vm)
+{
+  for (size_t i = 0; i < sizeof (BUILTINS) / sizeof (*BUILTINS); ++i)
+    {
+      struct value *value = vm_allocate (vm, TYPE_NATIVE);
+
+      value->p = (void *)&BUILTINS[i];
+      vm_define (vm, intern_string (BUILTINS[i].name), value_object (value));
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "vm.h"
+
+void builtins_register (struct vm *vm);
+
+#endif // BUILTINS_H
@@ -0,0 +1,261 @@
+#include "bytecode.h"
+#include "array.h"
+#include "common.h"
+#include <stdlib.h>
+
+#define READ_SHORT(code, offset)                                              \
+  ((size_t)((code)[(offset)] << 8 | (code)[(offset) + 1]))
+
+static const char *const OPCODES[] = {
+  "CONSTANT",
+  "VOID",
+  "POP",
+  "GET_GLOBAL",
+  "DEFINE_GLOBAL",
+  "GET_LOCAL",
+  "SET_LOCAL",
+  "GET_CAPTURED",
+  "SET_CAPTURED",
+  "CLOSURE",
+  "CALL",
+  "TAIL_CALL",
+  "GET_FIELD",
+  "TAIL_GET_FIELD",
+  "ARRAY",
+  "APPEND",
+  "EXTEND",
+  "STRUCTURE",
+  "RETURN"
+};
+
+struct function *
+function_create (size_t line)
+{
+  struct function *function;
+
+  function = calloc (1, sizeof (struct function));
+  function->chunk.code = array_create (16, sizeof (uint8_t));
+  function->chunk.lines = array_create (16, sizeof (size_t));
+  function->chunk.constants = array_create (4, sizeof (value_t));
+  function->chunk.objects = array_create (1, sizeof (struct value *));
+  function->chunk.functions = array_create (1, sizeof (struct function *));
+  function->names = array_create (1, sizeof (const char *));
+  function->line = line;
+
+  return function;
+}
+
+void
+function_destroy (struct function *function)
+{
+  struct chunk *chunk = &function->chunk;
+
+  for (size_t i = 0; i < array_length (chunk->objects); ++i)
+    value_destroy (NULL, value_object (chunk->objects[i]));
+
+  for (size_t i = 0; i < array_length (chunk->functions); ++i)
+    function_destroy (chunk->functions[i]);
+
+  array_destroy (chunk->code);
+  array_destroy (chunk->lines);
+  array_destroy (chunk->constants);
+  array_destroy (chunk->objects);
+  array_destroy (chunk->functions);
+  free (chunk->caches);
+  array_destroy (function->names);
+
+  free (function);
+}
+
+void
+chunk_write (struct chunk *chunk, uint8_t byte, size_t line)
+{
+  array_append (chunk->code, &byte);
+  array_append (chunk->lines, &line);
+}
+
+size_t
+chunk_add_constant (struct chunk *chunk, value_t value)
+{
+  array_append (chunk->constants, &value);
+  return array_length (chunk->constants) - 1;
+}
+
+size_t
+chunk_add_function (struct chunk *chunk, struct function *function)
+{
+  array_append (chunk->functions, &function);
+  return array_length (chunk->functions) - 1;
+}
+
+size_t
+chunk_add_cache (struct chunk *chunk)
+{
+  return chunk->cache_count++;
+}
+
+// Caches are only counted while the chunk is written, then allocated at
+// once here: they are much larger than the code that uses them.
+void
+chunk_create_caches (struct chunk *chunk)
+{
+  chunk->caches = calloc (chunk->cache_count, sizeof (struct cache));
+}
+
+static size_t
+disassemble_simple (uint8_t opcode, size_t offset, FILE *fd)
+{
+  fprintf (fd, "%s\n", opcode_string (opcode));
+  return offset + 1;
+}
+
+static size_t
+disassemble_constant (struct chunk *chunk, uint8_t opcode, size_t offset,
+                      FILE *fd)
+{
+  size_t index = READ_SHORT (chunk->code, offset + 1);
+
+  fprintf (fd, "%-16s %4zu ", opcode_string (opcode), index);
+  value_print (chunk->constants[index], fd);
+  fprintf (fd, "\n");
+
+  return offset + 3;
+}
+
+static size_t
+disassemble_short (struct chunk *chunk, uint8_t opcode, size_t offset,
+                   FILE *fd)
+{
+  size_t operand = READ_SHORT (chunk->code, offset + 1);
+
+  fprintf (fd, "%-16s %4zu\n", opcode_string (opcode), operand);
+  return offset + 3;
+}
+
+static size_t
+disassemble_call (struct chunk *chunk, uint8_t opcode, size_t offset,
+                  FILE *fd)
+{
+  size_t cache = READ_SHORT (chunk->code, offset + 2);
+
+  fprintf (fd, "%-16s %4u (cache %zu)\n", opcode_string (opcode),
+           chunk->code[offset + 1], cache);
+  return offset + 4;
+}
+
+static size_t
+disassemble_captured (struct chunk *chunk, uint8_t opcode, size_t offset,
+                      FILE *fd)
+{
+  size_t slot = READ_SHORT (chunk->code, offset + 2);
+
+  fprintf (fd, "%-16s %4u %4zu\n", opcode_string (opcode),
+           chunk->code[offset + 1], slot);
+  return offset + 4;
+}
+
+static size_t
+disassemble_field (struct chunk *chunk, uint8_t opcode, size_t offset,
+                   FILE *fd)
+{
+  size_t index = READ_SHORT (chunk->code, offset + 1);
+  size_t cache = READ_SHORT (chunk->code, offset + 3);
+
+  fprintf (fd, "%-16s %4zu ", opcode_string (opcode), index);
+  value_print (chunk->constants[index], fd);
+  fprintf (fd, " (cache %zu)\n", cache);
+
+  return offset + 5;
+}
+
+static size_t
+disassemble_structure (struct chunk *chunk, uint8_t opcode, size_t offset,
+                       FILE *fd)
+{
+  size_t count = READ_SHORT (chunk->code, offset + 1);
+  size_t cache = READ_SHORT (chunk->code, offset + 3);
+
+  fprintf (fd, "%-16s %4zu (cache %zu)", opcode_string (opcode), count,
+           cache);
+  offset += 5;
+
+  for (size_t i = 0; i < count; ++i, offset += 2)
+    {
+      fprintf (fd, " ");
+      value_print (chunk->constants[READ_SHORT (chunk->code, offset)], fd);
+    }
+
+  fprintf (fd, "\n");
+  return offset;
+}
+
+size_t
+chunk_disassemble_instruction (struct chunk *chunk, size_t offset, FILE *fd)
+{
+  uint8_t opcode = chunk->code[offset];
+
+  fprintf (fd, "%04zu ", offset);
+
+  if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1])
+    fprintf (fd, "   | ");
+  else
+    fprintf (fd, "%4zu ", chunk->lines[offset]);
+
+  switch (opcode)
+    {
+    case OP_CONSTANT:
+    case OP_DEFINE_GLOBAL:
+      return disassemble_constant (chunk, opcode, offset, fd);
+    case OP_CALL:
+    case OP_TAIL_CALL:
+      return disassemble_call (chunk, opcode, offset, fd);
+    case OP_GET_CAPTURED:
+    case OP_SET_CAPTURED:
+      return disassemble_captured (chunk, opcode, offset, fd);
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_CLOSURE:
+    case OP_ARRAY:
+    case OP_APPEND:
+      return disassemble_short (chunk, opcode, offset, fd);
+    case OP_GET_GLOBAL:
+    case OP_GET_FIELD:
+    case OP_TAIL_GET_FIELD:
+      return disassemble_field (chunk, opcode, offset, fd);
+    case OP_STRUCTURE:
+      return disassemble_structure (chunk, opcode, offset, fd);
+    case OP_VOID:
+    case OP_POP:
+    case OP_EXTEND:
+    case OP_RETURN:
+      return disassemble_simple (opcode, offset, fd);
+    }
+
+  error (chunk->lines[offset], "unknown opcode %u", opcode);
+}
+
+void
+function_disassemble (struct function *function, FILE *fd)
+{
+  struct chunk *chunk = &function->chunk;
+
+  fprintf (fd,
+           "== function (line %zu, arity %zu, slots %zu%s, stack %zu) ==\n",
+           function->line, function->arity, function->slots,
+           function->captured ? " captured" : "", function->stack_size);
+
+  for (size_t offset = 0; offset < array_length (chunk->code);)
+    offset = chunk_disassemble_instruction (chunk, offset, fd);
+
+  for (size_t i = 0; i < array_length (chunk->functions); ++i)
+    {
+      fprintf (fd, "\n");
+      function_disassemble (chunk->functions[i], fd);
+    }
+}
+
+const char *
+opcode_string (uint8_t opcode)
+{
+  return OPCODES[opcode];
+}
@@ -0,0 +1,108 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "shape.h"
+#include "value.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum
+{
+  OP_CONSTANT,
+  OP_VOID,
+  OP_POP,
+
+  OP_GET_GLOBAL,
+  OP_DEFINE_GLOBAL,
+  OP_GET_LOCAL,
+  OP_SET_LOCAL,
+  OP_GET_CAPTURED,
+  OP_SET_CAPTURED,
+
+  OP_CLOSURE,
+  OP_CALL,
+  OP_TAIL_CALL,
+  OP_GET_FIELD,
+  OP_TAIL_GET_FIELD,
+  OP_ARRAY,
+  OP_APPEND,
+  OP_EXTEND,
+  OP_STRUCTURE,
+
+  OP_RETURN
+};
+
+#define CACHE_WAYS 4
+
+// Inline cache of one instruction, starting out zeroed.
+//
+// Field reads keep the last CACHE_WAYS shapes seen, with the slot of the
+// field in each; once all ways are taken, further shapes are looked up
+// without caching them. OP_STRUCTURE keeps the shape it creates in the
+// first way.
+//
+// Global reads keep the cell index of the global in the VM with id `owner`.
+//
+// Calls keep the last function or native called, whose arity matched.
+struct cache
+{
+  union
+  {
+    struct
+    {
+      struct shape *shapes[CACHE_WAYS];
+      uint32_t slots[CACHE_WAYS];
+    };
+    struct
+    {
+      size_t owner;
+      size_t cell;
+    };
+    const void *callee;
+  };
+};
+
+// `objects` owns the strings, arrays and structures that the constants
+// refer to.
+struct chunk
+{
+  uint8_t *code;
+  size_t *lines;
+  value_t *constants;
+  struct value **objects;
+  struct function **functions;
+  struct cache *caches;
+  size_t cache_count;
+};
+
+// A function keeps its `slots` variables, named by `names` (parameters
+// first), in its stack frame, or in a heap environment when a nested
+// function has `captured` them.
+struct function
+{
+  struct chunk chunk;
+  const char **names;
+  size_t arity;
+  size_t slots;
+  bool captured;
+  size_t stack_size;
+  size_t line;
+};
+
+struct function *function_create (size_t line);
+void function_destroy (struct function *function);
+
+void chunk_write (struct chunk *chunk, uint8_t byte, size_t line);
+size_t chunk_add_constant (struct chunk *chunk, value_t value);
+size_t chunk_add_function (struct chunk *chunk, struct function *function);
+size_t chunk_add_cache (struct chunk *chunk);
+void chunk_create_caches (struct chunk *chunk);
+
+void function_disassemble (struct function *function, FILE *fd);
+size_t chunk_disassemble_instruction (struct chunk *chunk, size_t offset,
+                                      FILE *fd);
+
+const char *opcode_string (uint8_t opcode);
+
+#endif // BYTECODE_H
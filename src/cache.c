@@ -0,0 +1,399 @@
+#include "cache.h"
+#include "array.h"
+#include "intern.h"
+#include "tables.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The last byte is the format version; files of other versions are misses.
+#define CACHE_MAGIC "simple\0\4"
+#define CACHE_ALIGN 8
+#define CACHE_NONE ((uint32_t)-1)
+
+enum
+{
+  SECTION_TYPES,
+  SECTION_LINES,
+  SECTION_CHILDREN,
+  SECTION_NEXTS,
+  SECTION_PAYLOADS,
+  SECTION_DATA,
+  SECTION_STRINGS,
+  SECTION_TEXT,
+  SECTION_SOURCE,
+  SECTION_COUNT
+};
+
+// The file is named after the `hash` of the source, and keeps a copy of it
+// that must match before the tree is used. The header is followed by the
+// sections above, each aligned to CACHE_ALIGN. `checksum` covers the whole
+// file, taking itself as zero.
+struct cache_header
+{
+  char magic[8];
+  uint64_t hash;
+  uint64_t length;
+  uint32_t root;
+  uint32_t nodes;
+  uint32_t payloads;
+  uint32_t strings;
+  uint64_t text;
+  uint64_t checksum;
+};
+
+// A payload's decoded value is stored as the bits of `as`.
+struct cache_payload
+{
+  uint32_t string;
+  uint32_t as;
+};
+
+// Strings are NUL-terminated in the text section.
+struct cache_string
+{
+  uint32_t offset;
+  uint32_t length;
+};
+
+static uint64_t
+cache_hash (const char *source, size_t length)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (size_t i = 0; i < length; ++i)
+    hash = (hash ^ (uint8_t)source[i]) * 0x100000001b3;
+
+  return hash;
+}
+
+// Folds in `size` bytes a word at a time, as if padded with zeros to
+// CACHE_ALIGN the way every section is.
+static uint64_t
+cache_checksum (uint64_t checksum, const void *data, size_t size)
+{
+  const char *bytes = data;
+
+  for (size_t i = 0; i < size; i += sizeof (uint64_t))
+    {
+      uint64_t word = 0;
+
+      memcpy (&word, &bytes[i],
+              size - i < sizeof (word) ? size - i : sizeof (word));
+      checksum = (checksum ^ word) * 0x100000001b3;
+    }
+
+  return checksum;
+}
+
+static char *
+cache_path (const char *directory, uint64_t hash)
+{
+  size_t size = strlen (directory) + 32;
+  char *path = malloc (size);
+
+  snprintf (path, size, "%s/%016llx.ast", directory, (unsigned long long)hash);
+
+  return path;
+}
+
+// Sets the offset of every section and returns the size of the file.
+static size_t
+cache_layout (const struct cache_header *header,
+              size_t offsets[SECTION_COUNT])
+{
+  size_t sizes[SECTION_COUNT] = {
+    [SECTION_TYPES] = header->nodes * sizeof (uint8_t),
+    [SECTION_LINES] = header->nodes * sizeof (uint32_t),
+    [SECTION_CHILDREN] = header->nodes * sizeof (node_t),
+    [SECTION_NEXTS] = header->nodes * sizeof (node_t),
+    [SECTION_PAYLOADS] = header->nodes * sizeof (uint32_t),
+    [SECTION_DATA] = header->payloads * sizeof (struct cache_payload),
+    [SECTION_STRINGS] = header->strings * sizeof (struct cache_string),
+    [SECTION_TEXT] = header->text,
+    [SECTION_SOURCE] = header->length,
+  };
+  size_t offset = sizeof (struct cache_header);
+
+  for (size_t i = 0; i < SECTION_COUNT; ++i)
+    {
+      offsets[i] = offset;
+      offset += (sizes[i] + CACHE_ALIGN - 1) & ~(size_t)(CACHE_ALIGN - 1);
+    }
+
+  return offset;
+}
+
+static bool
+cache_index_valid (const uint32_t *indices, size_t count, size_t limit)
+{
+  for (size_t i = 0; i < count; ++i)
+    if (indices[i] != CACHE_NONE && indices[i] >= limit)
+      return false;
+
+  return true;
+}
+
+// Checks that every index stays inside its section. The shape of the tree
+// is not checked: the checksum has already rejected files that changed
+// since a parsed tree was written to them.
+static bool
+cache_valid (const struct cache_header *header, char *base,
+             size_t offsets[SECTION_COUNT])
+{
+  const uint8_t *types = (uint8_t *)(base + offsets[SECTION_TYPES]);
+  const struct cache_payload *data
+      = (struct cache_payload *)(base + offsets[SECTION_DATA]);
+  const struct cache_string *strings
+      = (struct cache_string *)(base + offsets[SECTION_STRINGS]);
+  const char *text = base + offsets[SECTION_TEXT];
+
+  if (header->root >= header->nodes)
+    return false;
+
+  for (size_t i = 0; i < header->nodes; ++i)
+    if (types[i] > AST_SYMBOL)
+      return false;
+
+  if (!cache_index_valid ((uint32_t *)(base + offsets[SECTION_CHILDREN]),
+                          header->nodes, header->nodes)
+      || !cache_index_valid ((uint32_t *)(base + offsets[SECTION_NEXTS]),
+                             header->nodes, header->nodes)
+      || !cache_index_valid ((uint32_t *)(base + offsets[SECTION_PAYLOADS]),
+                             header->nodes, header->payloads))
+    return false;
+
+  for (size_t i = 0; i < header->payloads; ++i)
+    if (data[i].string != CACHE_NONE && data[i].string >= header->strings)
+      return false;
+
+  for (size_t i = 0; i < header->strings; ++i)
+    if ((uint64_t)strings[i].offset + strings[i].length >= header->text
+        || text[strings[i].offset + strings[i].length] != '\0')
+      return false;
+
+  return true;
+}
+
+// Interns each string once and gives every payload its text back.
+static struct ast_payload *
+cache_payloads (const struct cache_header *header, char *base,
+                size_t offsets[SECTION_COUNT])
+{
+  const struct cache_payload *data
+      = (struct cache_payload *)(base + offsets[SECTION_DATA]);
+  const struct cache_string *strings
+      = (struct cache_string *)(base + offsets[SECTION_STRINGS]);
+  const char *text = base + offsets[SECTION_TEXT];
+  const char **interned = malloc (header->strings * sizeof (const char *));
+  struct ast_payload *payloads
+      = calloc (header->payloads, sizeof (struct ast_payload));
+
+  for (size_t i = 0; i < header->strings; ++i)
+    interned[i] = intern (&text[strings[i].offset], strings[i].length);
+
+  for (size_t i = 0; i < header->payloads; ++i)
+    {
+      if (data[i].string != CACHE_NONE)
+        {
+          payloads[i].text = interned[data[i].string];
+          payloads[i].length = strings[data[i].string].length;
+        }
+
+      memcpy (&payloads[i].as, &data[i].as, sizeof (data[i].as));
+    }
+
+  free (interned);
+
+  return payloads;
+}
+
+struct ast *
+cache_load (const char *directory, const char *source, size_t length)
+{
+  uint64_t hash = cache_hash (source, length);
+  char *path = cache_path (directory, hash);
+  int fd = open (path, O_RDONLY);
+  struct stat status;
+
+  free (path);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &status) < 0
+      || (size_t)status.st_size < sizeof (struct cache_header))
+    {
+      close (fd);
+      return NULL;
+    }
+
+  char *base = mmap (NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close (fd);
+
+  if (base == MAP_FAILED)
+    return NULL;
+
+  struct cache_header *header = (struct cache_header *)base;
+  struct cache_header unsummed = *header;
+  size_t offsets[SECTION_COUNT];
+
+  unsummed.checksum = 0;
+
+  if (memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0
+      || header->hash != hash || header->length != length
+      || header->text > (size_t)status.st_size
+      || cache_layout (header, offsets) != (size_t)status.st_size
+      || cache_checksum (cache_checksum (0, &unsummed, sizeof (unsummed)),
+                         base + sizeof (unsummed),
+                         status.st_size - sizeof (unsummed))
+             != header->checksum
+      || (length > 0
+          && memcmp (base + offsets[SECTION_SOURCE], source, length) != 0)
+      || !cache_valid (header, base, offsets))
+    {
+      munmap (base, status.st_size);
+      return NULL;
+    }
+
+  struct ast *ast = calloc (1, sizeof (struct ast));
+
+  ast->length = header->nodes;
+  ast->types = (uint8_t *)(base + offsets[SECTION_TYPES]);
+  ast->lines = (uint32_t *)(base + offsets[SECTION_LINES]);
+  ast->children = (node_t *)(base + offsets[SECTION_CHILDREN]);
+  ast->nexts = (node_t *)(base + offsets[SECTION_NEXTS]);
+  ast->payloads = (uint32_t *)(base + offsets[SECTION_PAYLOADS]);
+  ast->data = cache_payloads (header, base, offsets);
+  ast->data_length = ast->data_capacity = header->payloads;
+  ast->root = header->root;
+  ast->mapping = base;
+  ast->mapping_size = status.st_size;
+
+  return ast;
+}
+
+static void
+cache_write (FILE *fd, const void *data, size_t size, uint64_t *checksum)
+{
+  static const char padding[CACHE_ALIGN];
+
+  fwrite (data, 1, size, fd);
+  fwrite (padding, 1, -size & (CACHE_ALIGN - 1), fd);
+  *checksum = cache_checksum (*checksum, data, size);
+}
+
+void
+cache_store (const char *directory, const char *source, size_t length,
+             struct ast *ast)
+{
+  struct cache_header header = { 0 };
+  struct cache_payload *data;
+  struct cache_string *strings;
+  struct hash_table *indices = hash_table_create (NULL, 64);
+  char *text = array_create (1024, sizeof (char));
+
+  memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+  header.hash = cache_hash (source, length);
+  header.length = length;
+  header.root = ast->root;
+  header.nodes = ast->length;
+  header.payloads = ast->data_length;
+
+  data = malloc (header.payloads * sizeof (struct cache_payload));
+  strings = array_create (64, sizeof (struct cache_string));
+
+  // Texts are interned, so each distinct string is stored once.
+  for (size_t i = 0; i < header.payloads; ++i)
+    {
+      struct ast_payload *payload = &ast->data[i];
+
+      memcpy (&data[i].as, &payload->as, sizeof (data[i].as));
+      data[i].string = CACHE_NONE;
+
+      if (payload->text == NULL)
+        continue;
+
+      const char *key = payload->text;
+      value_t index = hash_table_find (indices, key);
+
+      if (index == VALUE_NONE)
+        {
+          struct cache_string string = { array_length (text),
+                                         payload->length };
+
+          index = value_integer (array_length (strings));
+          hash_table_append (indices, key, index);
+          array_append (strings, &string);
+
+          for (size_t j = 0; j <= payload->length; ++j)
+            array_append (text, &key[j]);
+        }
+
+      data[i].string = value_as_integer (index);
+    }
+
+  header.strings = array_length (strings);
+  header.text = array_length (text);
+
+  char *path = cache_path (directory, header.hash);
+  size_t size = strlen (path) + 32;
+  char *temporary = malloc (size);
+  FILE *fd;
+
+  // Written aside and renamed into place, so concurrent runs only ever see
+  // complete files.
+  snprintf (temporary, size, "%s.%ld", path, (long)getpid ());
+  mkdir (directory, 0777);
+
+  if ((fd = fopen (temporary, "wb")) == NULL)
+    perror (temporary);
+  else
+    {
+      uint64_t checksum = 0;
+
+      // The header is written again once the checksum is known.
+      cache_write (fd, &header, sizeof (header), &checksum);
+      cache_write (fd, ast->types, header.nodes * sizeof (uint8_t),
+                   &checksum);
+      cache_write (fd, ast->lines, header.nodes * sizeof (uint32_t),
+                   &checksum);
+      cache_write (fd, ast->children, header.nodes * sizeof (node_t),
+                   &checksum);
+      cache_write (fd, ast->nexts, header.nodes * sizeof (node_t),
+                   &checksum);
+      cache_write (fd, ast->payloads, header.nodes * sizeof (uint32_t),
+                   &checksum);
+      cache_write (fd, data, header.payloads * sizeof (*data), &checksum);
+      cache_write (fd, strings, header.strings * sizeof (*strings),
+                   &checksum);
+      cache_write (fd, text, header.text, &checksum);
+      cache_write (fd, source, length, &checksum);
+
+      header.checksum = checksum;
+      rewind (fd);
+      fwrite (&header, 1, sizeof (header), fd);
+
+      bool failed = ferror (fd);
+
+      failed |= fclose (fd) != 0;
+
+      if (failed || rename (temporary, path) != 0)
+        {
+          perror (temporary);
+          unlink (temporary);
+        }
+    }
+
+  free (temporary);
+  free (path);
+  free (data);
+  array_destroy (strings);
+  array_destroy (text);
+  hash_table_destroy (indices);
+}
@@ -0,0 +1,18 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "ast.h"
+
+// Parsed programs saved in `directory`, one file per source text, named by
+// a hash of it. Files hold the node arrays of the tree as they are in
+// memory, followed by the payloads and their strings, with offsets instead
+// of pointers; loading maps the file and only interns the strings.
+//
+// A missing, stale or damaged file is a miss, and `cache_store ()` replaces
+// it. Failing to write is reported but never fatal.
+struct ast *cache_load (const char *directory, const char *source,
+                        size_t length);
+void cache_store (const char *directory, const char *source, size_t length,
+                  struct ast *ast);
+
+#endif // CACHE_H
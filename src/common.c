@@ -16,10 +16,24 @@ xstrdup (const char *s)
   return ptr;
 }
 
+char *
+xstrndup (const char *s, size_t length)
+{
+  char *ptr;
+
+  ptr = calloc (length + 1, sizeof (char));
+  memcpy (ptr, s, length);
+
+  return ptr;
+}
+
+jmp_buf *error_recovery;
+
 _Noreturn void
 error (size_t line, const char *fmt, ...)
 {
-  fprintf (stderr, "fatal-error (line %zu): ", line);
+  fprintf (stderr, "%s (line %zu): ",
+           error_recovery != NULL ? "error" : "fatal-error", line);
 
   va_list va;
   va_start (va, fmt);
@@ -27,6 +41,10 @@ error (size_t line, const char *fmt, ...)
   va_end (va);
 
   fprintf (stderr, "\n");
+
+  if (error_recovery != NULL)
+    longjmp (*error_recovery, 1);
+
   exit (EXIT_FAILURE);
 }
 
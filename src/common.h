@@ -1,9 +1,14 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <setjmp.h>
 #include <stddef.h>
 
 char *xstrdup (const char *s);
+char *xstrndup (const char *s, size_t length);
+
+// While set, `error ()` jumps back there after reporting instead of exiting.
+extern jmp_buf *error_recovery;
 
 _Noreturn void error (size_t line, const char *fmt, ...);
 
@@ -0,0 +1,661 @@
+#include "compiler.h"
+#include "array.h"
+#include "common.h"
+#include "resolver.h"
+#include "shape.h"
+#include "tables.h"
+#include "vector.h"
+
+#define BYTE_MAX 0xff
+#define SHORT_MAX 0xffff
+
+// Elements of an array literal that are not constant are pushed and added
+// to the array this many at a time, so the stack stays small.
+#define ARRAY_BATCH 256
+
+// `constants` maps the bits of each constant to its index, and `strings`
+// the text of each string literal to its object.
+struct compiler
+{
+  struct compiler *enclosing;
+  struct ast *ast;
+  struct function *function;
+  size_t depth;
+  struct hash_table *constants;
+  struct hash_table *strings;
+};
+
+// Copies of the compilers that have started and not finished, innermost
+// last. An error unwinds past their frames, so `compile_abandon ()` finds
+// what they own here.
+static struct compiler *unfinished;
+
+static void compile_node (struct compiler *compiler, node_t node);
+static void compile_function_invocation (struct compiler *compiler,
+                                         node_t node, bool tail);
+
+static void
+compiler_emit (struct compiler *compiler, uint8_t byte, size_t line)
+{
+  chunk_write (&compiler->function->chunk, byte, line);
+}
+
+static void
+compiler_emit_short (struct compiler *compiler, size_t operand, size_t line)
+{
+  if (operand > SHORT_MAX)
+    error (line, "operand %zu does not fit in an instruction", operand);
+
+  compiler_emit (compiler, (operand >> 8) & 0xff, line);
+  compiler_emit (compiler, operand & 0xff, line);
+}
+
+static void
+compiler_adjust (struct compiler *compiler, size_t push, size_t pop)
+{
+  compiler->depth = compiler->depth + push - pop;
+
+  if (compiler->depth > compiler->function->stack_size)
+    compiler->function->stack_size = compiler->depth;
+}
+
+static void
+compiler_init (struct compiler *compiler, struct compiler *enclosing,
+               struct ast *ast, size_t line)
+{
+  compiler->enclosing = enclosing;
+  compiler->ast = ast;
+  compiler->function = function_create (line);
+  compiler->depth = 0;
+  compiler->constants = hash_table_create (NULL, 16);
+  compiler->strings = hash_table_create (NULL, 4);
+
+  if (unfinished == NULL)
+    unfinished = array_create (4, sizeof (struct compiler));
+
+  array_append (unfinished, compiler);
+}
+
+static void
+compiler_finish (struct compiler *compiler)
+{
+  chunk_create_caches (&compiler->function->chunk);
+
+  hash_table_destroy (compiler->constants);
+  hash_table_destroy (compiler->strings);
+
+  array_truncate (unfinished, array_length (unfinished) - 1);
+
+  if (array_length (unfinished) == 0)
+    {
+      array_destroy (unfinished);
+      unfinished = NULL;
+    }
+}
+
+// Equal constants share one index; numbers and symbols are equal when their
+// bits are, and objects when they are the same object.
+static size_t
+compiler_add_constant (struct compiler *compiler, value_t value, size_t line)
+{
+  const char *key = (const char *)(uintptr_t)value;
+  value_t known = hash_table_find (compiler->constants, key);
+
+  if (known != VALUE_NONE)
+    return value_as_integer (known);
+
+  size_t index = chunk_add_constant (&compiler->function->chunk, value);
+
+  if (index > SHORT_MAX)
+    error (line, "too many constants in one function");
+
+  hash_table_append (compiler->constants, key, value_integer (index));
+
+  return index;
+}
+
+static size_t
+compiler_add_name (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+
+  return compiler_add_constant (compiler,
+                                value_symbol (ast_payload (ast, node)->text),
+                                ast->lines[node]);
+}
+
+static value_t
+compiler_object (struct compiler *compiler, size_t type, void *p)
+{
+  struct value *value = value_create (NULL, type);
+
+  value->constant = true;
+  value->p = p;
+  array_append (compiler->function->chunk.objects, &value);
+
+  return value_object (value);
+}
+
+// String literals share their interned text, and each distinct one is a
+// single object of the function.
+static value_t
+compiler_string (struct compiler *compiler, const char *text)
+{
+  value_t value = hash_table_find (compiler->strings, text);
+
+  if (value == VALUE_NONE)
+    {
+      value = compiler_object (compiler, TYPE_STRING, (void *)text);
+      hash_table_append (compiler->strings, text, value);
+    }
+
+  return value;
+}
+
+// Whether `node` is a literal, or an array or structure of literals. Those
+// are built once, by `compiler_fold ()`, and become a single constant.
+static bool
+compiler_literal (struct ast *ast, node_t node)
+{
+  node_t current = ast->children[node];
+
+  switch (ast->types[node])
+    {
+    case AST_INTEGER:
+    case AST_FLOAT:
+    case AST_STRING:
+    case AST_SYMBOL:
+      return true;
+    case AST_ARRAY:
+      for (; current != AST_NONE; current = ast->nexts[current])
+        if (!compiler_literal (ast, current))
+          return false;
+      return true;
+    case AST_STRUCTURE:
+      for (; current != AST_NONE; current = ast->nexts[current])
+        if (!compiler_literal (ast, ast->nexts[ast->children[current]]))
+          return false;
+      return true;
+    default:
+      return false;
+    }
+}
+
+static value_t compiler_fold (struct compiler *compiler, node_t node);
+
+// Builds the array of the literals from `first` up to `end`.
+static value_t
+compiler_fold_array (struct compiler *compiler, node_t first, node_t end)
+{
+  struct vector *vector = vector_create (NULL);
+
+  vector_transient (vector);
+
+  for (node_t current = first; current != end;
+       current = compiler->ast->nexts[current])
+    vector_push (vector, compiler_fold (compiler, current));
+
+  vector_persist (vector);
+
+  return compiler_object (compiler, TYPE_ARRAY, vector);
+}
+
+static value_t
+compiler_fold (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+  struct ast_payload *payload = ast_payload (ast, node);
+
+  switch (ast->types[node])
+    {
+    case AST_INTEGER:
+      return value_integer (payload->as.integer);
+    case AST_FLOAT:
+      return value_float (payload->as.floating);
+    case AST_STRING:
+      return compiler_string (compiler, payload->text);
+    case AST_SYMBOL:
+      return value_symbol (payload->text);
+    case AST_ARRAY:
+      return compiler_fold_array (compiler, ast->children[node], AST_NONE);
+    default:
+      {
+        struct shape *shape = shape_root ();
+        struct structure *structure;
+        size_t i = 0;
+
+        for (node_t current = ast->children[node]; current != AST_NONE;
+             current = ast->nexts[current])
+          shape = shape_add (shape,
+                             ast_payload (ast, ast->children[current])->text);
+
+        structure = structure_create (NULL, shape);
+
+        for (node_t current = ast->children[node]; current != AST_NONE;
+             current = ast->nexts[current])
+          structure->slots[i++]
+              = compiler_fold (compiler, ast->nexts[ast->children[current]]);
+
+        return compiler_object (compiler, TYPE_STRUCTURE, structure);
+      }
+    }
+}
+
+static size_t
+compiler_add_cache (struct compiler *compiler, size_t line)
+{
+  size_t index = chunk_add_cache (&compiler->function->chunk);
+
+  if (index > SHORT_MAX)
+    error (line, "too many inline caches in one function");
+
+  return index;
+}
+
+// Emits the access to the variable `node` was resolved to. Only captured
+// functions keep an environment, so the hop count skips the others.
+static void
+compile_variable (struct compiler *compiler, node_t node, node_t name,
+                  bool define)
+{
+  struct ast_payload *payload = ast_payload (compiler->ast, node);
+  size_t line = compiler->ast->lines[node];
+
+  if (payload->depth == AST_GLOBAL)
+    {
+      size_t index = compiler_add_name (compiler, name);
+
+      compiler_emit (compiler, define ? OP_DEFINE_GLOBAL : OP_GET_GLOBAL,
+                     line);
+      compiler_emit_short (compiler, index, line);
+
+      if (!define)
+        compiler_emit_short (compiler, compiler_add_cache (compiler, line),
+                             line);
+      return;
+    }
+
+  struct compiler *target = compiler;
+  size_t hops = 0;
+
+  for (size_t i = 0; i < payload->depth; ++i, target = target->enclosing)
+    hops += target->function->captured;
+
+  if (!target->function->captured)
+    {
+      compiler_emit (compiler, define ? OP_SET_LOCAL : OP_GET_LOCAL, line);
+      compiler_emit_short (compiler, payload->slot, line);
+      return;
+    }
+
+  if (hops > BYTE_MAX)
+    error (line, "`%s` is nested too deeply",
+           ast_payload (compiler->ast, name)->text);
+
+  compiler_emit (compiler, define ? OP_SET_CAPTURED : OP_GET_CAPTURED, line);
+  compiler_emit (compiler, hops, line);
+  compiler_emit_short (compiler, payload->slot, line);
+}
+
+static void
+compile_constant (struct compiler *compiler, value_t value, size_t line)
+{
+  size_t index = compiler_add_constant (compiler, value, line);
+
+  compiler_emit (compiler, OP_CONSTANT, line);
+  compiler_emit_short (compiler, index, line);
+  compiler_adjust (compiler, 1, 0);
+}
+
+static void
+compile_program (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+
+  for (node_t current = ast->children[node]; current != AST_NONE;
+       current = ast->nexts[current])
+    {
+      compile_node (compiler, current);
+
+      if (ast->types[current] == AST_RETURN)
+        return;
+
+      compiler_emit (compiler, OP_POP, ast->lines[current]);
+      compiler_adjust (compiler, 0, 1);
+    }
+
+  compiler_emit (compiler, OP_VOID, ast->lines[node]);
+  compiler_emit (compiler, OP_RETURN, ast->lines[node]);
+}
+
+static void
+compile_return (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+  node_t child = ast->children[node];
+
+  if (ast->types[child] == AST_FUNCTION_INVOCATION)
+    compile_function_invocation (compiler, child, true);
+  else
+    compile_node (compiler, child);
+
+  compiler_emit (compiler, OP_RETURN, ast->lines[node]);
+  compiler_adjust (compiler, 0, 1);
+}
+
+static void
+compile_variable_declaration (struct compiler *compiler, node_t node)
+{
+  node_t identifier = compiler->ast->children[node];
+  node_t expression = compiler->ast->nexts[identifier];
+
+  compile_node (compiler, expression);
+  compile_variable (compiler, node, identifier, true);
+}
+
+static void
+compile_function_definition (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+  struct compiler inner;
+  struct scope *scope = ast_payload (ast, node)->scope;
+  node_t current = ast->children[node];
+  size_t line = ast->lines[node];
+
+  compiler_init (&inner, compiler, ast, line);
+
+  for (; ast->types[current] == AST_IDENTIFIER; current = ast->nexts[current])
+    inner.function->arity++;
+
+  for (size_t i = 0; i < scope->length; ++i)
+    array_append (inner.function->names, &scope->names[i]);
+
+  if (scope->length > SHORT_MAX)
+    error (line, "too many variables in one function");
+
+  inner.function->slots = scope->length;
+  inner.function->captured = scope->captured;
+
+  // The callee, then the variables unless they live in an environment.
+  compiler_adjust (&inner, 1 + (scope->captured ? 0 : scope->length), 0);
+  compile_program (&inner, current);
+  compiler_finish (&inner);
+
+  size_t index = chunk_add_function (&compiler->function->chunk,
+                                     inner.function);
+
+  compiler_emit (compiler, OP_CLOSURE, line);
+  compiler_emit_short (compiler, index, line);
+  compiler_adjust (compiler, 1, 0);
+}
+
+// `(callee 'name)` reads a field when the callee is a structure, so it gets
+// an inline cache; OP_GET_FIELD makes an ordinary call otherwise, which
+// OP_TAIL_GET_FIELD makes in place of the caller's frame.
+static void
+compile_field (struct compiler *compiler, node_t node, bool tail)
+{
+  node_t callee = compiler->ast->children[node];
+  size_t line = compiler->ast->lines[node];
+
+  compile_node (compiler, callee);
+
+  compiler_emit (compiler, tail ? OP_TAIL_GET_FIELD : OP_GET_FIELD, line);
+  compiler_emit_short (compiler,
+                       compiler_add_name (compiler,
+                                          compiler->ast->nexts[callee]),
+                       line);
+  compiler_emit_short (compiler, compiler_add_cache (compiler, line), line);
+  // The ordinary call needs the name pushed as its argument.
+  compiler_adjust (compiler, 1, 0);
+  compiler_adjust (compiler, 1, 2);
+}
+
+// A call in `tail` position replaces the caller's frame when the callee
+// is a function, so recursion through returned calls runs in constant
+// space. The OP_RETURN after it is only reached from other callees.
+static void
+compile_function_invocation (struct compiler *compiler, node_t node,
+                             bool tail)
+{
+  struct ast *ast = compiler->ast;
+  node_t argument = ast->nexts[ast->children[node]];
+  size_t line = ast->lines[node];
+  size_t count = 0;
+
+  if (argument != AST_NONE && ast->types[argument] == AST_SYMBOL
+      && ast->nexts[argument] == AST_NONE)
+    {
+      compile_field (compiler, node, tail);
+      return;
+    }
+
+  for (node_t current = ast->children[node]; current != AST_NONE;
+       current = ast->nexts[current])
+    {
+      compile_node (compiler, current);
+      count++;
+    }
+
+  if (count - 1 > BYTE_MAX)
+    error (line, "too many arguments in invocation");
+
+  compiler_emit (compiler, tail ? OP_TAIL_CALL : OP_CALL, line);
+  compiler_emit (compiler, count - 1, line);
+  compiler_emit_short (compiler, compiler_add_cache (compiler, line), line);
+  compiler_adjust (compiler, 1, count);
+}
+
+static void
+compile_array_batch (struct compiler *compiler, size_t count, bool created,
+                     size_t line)
+{
+  compiler_emit (compiler, created ? OP_APPEND : OP_ARRAY, line);
+  compiler_emit_short (compiler, count, line);
+  compiler_adjust (compiler, created ? 0 : 1, count);
+}
+
+// An array of literals is a constant. Otherwise the elements are pushed in
+// batches, except for runs of at least ARRAY_BATCH literals, which are
+// folded into a constant array and added with OP_EXTEND.
+static void
+compile_array (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+  node_t current = ast->children[node];
+  size_t line = ast->lines[node];
+  size_t count = 0;
+  bool created = false;
+
+  if (compiler_literal (ast, node))
+    {
+      compile_constant (compiler, compiler_fold (compiler, node), line);
+      return;
+    }
+
+  while (current != AST_NONE)
+    {
+      node_t end = current;
+      size_t run = 0;
+
+      for (; end != AST_NONE && compiler_literal (ast, end);
+           end = ast->nexts[end])
+        run++;
+
+      if (run >= ARRAY_BATCH)
+        {
+          if (count > 0 || !created)
+            compile_array_batch (compiler, count, created, line);
+
+          created = true;
+          count = 0;
+
+          compile_constant (compiler,
+                            compiler_fold_array (compiler, current, end),
+                            line);
+          compiler_emit (compiler, OP_EXTEND, line);
+          compiler_adjust (compiler, 0, 1);
+
+          current = end;
+          continue;
+        }
+
+      if (run == 0)
+        end = ast->nexts[current];
+
+      for (; current != end; current = ast->nexts[current])
+        {
+          compile_node (compiler, current);
+
+          if (++count == ARRAY_BATCH)
+            {
+              compile_array_batch (compiler, count, created, line);
+              created = true;
+              count = 0;
+            }
+        }
+    }
+
+  if (count > 0 || !created)
+    compile_array_batch (compiler, count, created, line);
+}
+
+static void
+compile_structure (struct compiler *compiler, node_t node)
+{
+  struct ast *ast = compiler->ast;
+  size_t line = ast->lines[node];
+  size_t count = 0;
+
+  if (compiler_literal (ast, node))
+    {
+      compile_constant (compiler, compiler_fold (compiler, node), line);
+      return;
+    }
+
+  for (node_t current = ast->children[node]; current != AST_NONE;
+       current = ast->nexts[current])
+    {
+      compile_node (compiler, ast->nexts[ast->children[current]]);
+      count++;
+    }
+
+  compiler_emit (compiler, OP_STRUCTURE, line);
+  compiler_emit_short (compiler, count, line);
+  compiler_emit_short (compiler, compiler_add_cache (compiler, line), line);
+
+  for (node_t current = ast->children[node]; current != AST_NONE;
+       current = ast->nexts[current])
+    {
+      size_t index = compiler_add_name (compiler, ast->children[current]);
+
+      compiler_emit_short (compiler, index, line);
+    }
+
+  compiler_adjust (compiler, 1, count);
+}
+
+static void
+compile_literal (struct compiler *compiler, node_t node)
+{
+  compile_constant (compiler, compiler_fold (compiler, node),
+                    compiler->ast->lines[node]);
+}
+
+static void
+compile_identifier (struct compiler *compiler, node_t node)
+{
+  compile_variable (compiler, node, node, false);
+  compiler_adjust (compiler, 1, 0);
+}
+
+static void
+compile_symbol (struct compiler *compiler, node_t node)
+{
+  size_t index = compiler_add_name (compiler, node);
+  size_t line = compiler->ast->lines[node];
+
+  compiler_emit (compiler, OP_CONSTANT, line);
+  compiler_emit_short (compiler, index, line);
+  compiler_adjust (compiler, 1, 0);
+}
+
+static void
+compile_node (struct compiler *compiler, node_t node)
+{
+  size_t type = compiler->ast->types[node];
+
+  switch (type)
+    {
+    case AST_PROGRAM:
+      compile_program (compiler, node);
+      return;
+    case AST_RETURN:
+      compile_return (compiler, node);
+      return;
+    case AST_VARIABLE_DECLARATION:
+      compile_variable_declaration (compiler, node);
+      return;
+    case AST_FUNCTION_DEFINITION:
+      compile_function_definition (compiler, node);
+      return;
+    case AST_FUNCTION_INVOCATION:
+      compile_function_invocation (compiler, node, false);
+      return;
+    case AST_ARRAY:
+      compile_array (compiler, node);
+      return;
+    case AST_STRUCTURE:
+      compile_structure (compiler, node);
+      return;
+    case AST_INTEGER:
+    case AST_FLOAT:
+    case AST_STRING:
+      compile_literal (compiler, node);
+      return;
+    case AST_IDENTIFIER:
+      compile_identifier (compiler, node);
+      return;
+    case AST_SYMBOL:
+      compile_symbol (compiler, node);
+      return;
+    }
+
+  error (compiler->ast->lines[node], "`compile ()` cannot handle `%s` node",
+         ast_type_string (type));
+}
+
+struct function *
+compile (struct ast *ast)
+{
+  struct compiler compiler;
+
+  compiler_init (&compiler, NULL, ast, ast->lines[ast->root]);
+
+  compiler_adjust (&compiler, 1, 0);
+  compile_node (&compiler, ast->root);
+  compiler_finish (&compiler);
+
+  return compiler.function;
+}
+
+// A function only owns those nested in it once they are finished, so each
+// unfinished one is destroyed on its own.
+void
+compile_abandon (void)
+{
+  if (unfinished == NULL)
+    return;
+
+  for (size_t i = array_length (unfinished); i > 0; --i)
+    {
+      struct compiler *compiler = &unfinished[i - 1];
+
+      function_destroy (compiler->function);
+      hash_table_destroy (compiler->constants);
+      hash_table_destroy (compiler->strings);
+    }
+
+  array_destroy (unfinished);
+  unfinished = NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "ast.h"
+#include "bytecode.h"
+
+struct function *compile (struct ast *ast);
+
+// Frees what a `compile ()` that an error interrupted had built.
+void compile_abandon (void);
+
+#endif // COMPILER_H
@@ -0,0 +1,36 @@
+#include "environment.h"
+#include <stdlib.h>
+
+size_t
+environment_size (size_t length)
+{
+  return sizeof (struct environment) + length * sizeof (value_t);
+}
+
+struct environment *
+environment_create (struct pool *pool, struct environment *parent,
+                    const char **names, size_t length)
+{
+  struct environment *environment;
+  size_t size = environment_size (length);
+
+  if (size <= POOL_MAX_SIZE)
+    environment = pool_allocate (pool, size);
+  else
+    environment = calloc (1, size);
+
+  environment->parent = parent;
+  environment->names = names;
+  environment->length = length;
+
+  return environment;
+}
+
+void
+environment_destroy (struct pool *pool, struct environment *environment)
+{
+  if (environment_size (environment->length) <= POOL_MAX_SIZE)
+    pool_free (pool, environment);
+  else
+    free (environment);
+}
@@ -0,0 +1,27 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "pool.h"
+#include "value.h"
+#include <stdbool.h>
+
+// The variables of a call to a captured function, addressed by slot. They
+// outlive the call for as long as closures created in it do.
+struct environment
+{
+  struct environment *parent;
+  const char **names;
+  size_t length;
+  bool marked;
+  value_t slots[];
+};
+
+size_t environment_size (size_t length);
+
+struct environment *environment_create (struct pool *pool,
+                                        struct environment *parent,
+                                        const char **names, size_t length);
+void environment_destroy (struct pool *pool,
+                          struct environment *environment);
+
+#endif // ENVIRONMENT_H
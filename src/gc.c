@@ -0,0 +1,245 @@
+#include "gc.h"
+#include "array.h"
+#include "vm.h"
+#include <stdbool.h>
+#include <time.h>
+
+// Collections so far in any VM. Vectors in constants are shared between
+// VMs, so their nodes are stamped with this rather than `collections`.
+static size_t epochs;
+
+static double
+gc_seconds (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void
+gc_mark_value (struct gc *gc, value_t value)
+{
+  if (!VALUE_IS_OBJECT (value) || value == VALUE_NONE)
+    return;
+
+  struct value *object = value_as_object (value);
+
+  if (object->marked || object->constant)
+    return;
+
+  object->marked = true;
+
+  if (object->type == TYPE_ARRAY || object->type == TYPE_STRUCTURE
+      || object->type == TYPE_FUNTION)
+    array_append (gc->gray, &object);
+}
+
+static void
+gc_mark_environment (struct gc *gc, struct environment *environment)
+{
+  if (environment == NULL || environment->marked)
+    return;
+
+  environment->marked = true;
+  array_append (gc->gray_environments, &environment);
+}
+
+// Returns the size of the nodes traced for the first time.
+static size_t
+gc_trace_vector (struct gc *gc, struct vector_node *node, size_t shift)
+{
+  size_t bytes = sizeof (struct vector_node);
+
+  if (node == NULL || node->epoch == gc->epoch)
+    return 0;
+
+  node->epoch = gc->epoch;
+
+  for (size_t i = 0; i < VECTOR_WIDTH; ++i)
+    if (shift == 0)
+      gc_mark_value (gc, node->items[i]);
+    else
+      bytes += gc_trace_vector (gc, node->children[i], shift - VECTOR_BITS);
+
+  return bytes;
+}
+
+static size_t
+gc_trace_value (struct gc *gc, struct value *object)
+{
+  switch (object->type)
+    {
+    case TYPE_ARRAY:
+      {
+        struct vector *vector = object->p;
+
+        return gc_trace_vector (gc, vector->root, vector->shift);
+      }
+    case TYPE_STRUCTURE:
+      {
+        struct structure *structure = object->p;
+
+        for (size_t i = 0; i < structure->shape->length; ++i)
+          gc_mark_value (gc, structure->slots[i]);
+        break;
+      }
+    case TYPE_FUNTION:
+      gc_mark_environment (gc, ((struct closure *)object->p)->environment);
+      break;
+    }
+
+  return 0;
+}
+
+static void
+gc_trace_environment (struct gc *gc, struct environment *environment)
+{
+  for (size_t i = 0; i < environment->length; ++i)
+    gc_mark_value (gc, environment->slots[i]);
+
+  gc_mark_environment (gc, environment->parent);
+}
+
+// Returns the size of the vector nodes reached, which are all live.
+static size_t
+gc_mark (struct vm *vm)
+{
+  struct gc *gc = &vm->gc;
+  size_t bytes = 0;
+
+  for (value_t *slot = vm->stack; slot < vm->top; ++slot)
+    gc_mark_value (gc, *slot);
+
+  for (size_t i = 0; i < vm->depth; ++i)
+    gc_mark_environment (gc, vm->frames[i].environment);
+
+  for (size_t i = 0; i < array_length (vm->cells); ++i)
+    gc_mark_value (gc, vm->cells[i]);
+
+  // Objects are traced from explicit gray stacks rather than by recursion,
+  // so deeply nested data cannot overflow the C stack.
+  for (;;)
+    {
+      size_t values = array_length (gc->gray);
+      size_t environments = array_length (gc->gray_environments);
+
+      if (values > 0)
+        {
+          array_truncate (gc->gray, values - 1);
+          bytes += gc_trace_value (gc, gc->gray[values - 1]);
+        }
+      else if (environments > 0)
+        {
+          array_truncate (gc->gray_environments, environments - 1);
+          gc_trace_environment (gc,
+                                gc->gray_environments[environments - 1]);
+        }
+      else
+        break;
+    }
+
+  return bytes;
+}
+
+static size_t
+gc_sweep (struct vm *vm)
+{
+  size_t kept = 0;
+  size_t bytes = 0;
+  size_t freed = 0;
+
+  for (size_t i = 0; i < array_length (vm->values); ++i)
+    {
+      struct value *value = vm->values[i];
+
+      if (value->marked)
+        {
+          value->marked = false;
+          vm->values[kept++] = value;
+          bytes += value_size (value);
+        }
+      else
+        {
+          value_destroy (vm->pool, value_object (value));
+          freed++;
+        }
+    }
+
+  array_truncate (vm->values, kept);
+  kept = 0;
+
+  for (size_t i = 0; i < array_length (vm->environments); ++i)
+    {
+      struct environment *environment = vm->environments[i];
+
+      if (environment->marked)
+        {
+          environment->marked = false;
+          vm->environments[kept++] = environment;
+          bytes += environment_size (environment->length);
+        }
+      else
+        {
+          environment_destroy (vm->pool, environment);
+          freed++;
+        }
+    }
+
+  array_truncate (vm->environments, kept);
+
+  vm->gc.freed += freed;
+
+  return bytes;
+}
+
+void
+gc_init (struct gc *gc)
+{
+  gc->threshold = GC_THRESHOLD;
+  gc->minimum = GC_THRESHOLD;
+  gc->growth = GC_GROWTH;
+  gc->gray = array_create (64, sizeof (struct value *));
+  gc->gray_environments = array_create (16, sizeof (struct environment *));
+}
+
+void
+gc_destroy (struct gc *gc)
+{
+  array_destroy (gc->gray);
+  array_destroy (gc->gray_environments);
+}
+
+void
+gc_collect (struct vm *vm)
+{
+  struct gc *gc = &vm->gc;
+  double start = gc_seconds ();
+
+  gc->collections++;
+  gc->epoch = ++epochs;
+  gc->bytes = gc_mark (vm);
+  gc->bytes += gc_sweep (vm);
+  gc->nodes = vector_count ();
+
+  double threshold = gc->bytes * gc->growth;
+
+  gc->threshold = threshold > gc->minimum ? threshold : gc->minimum;
+
+  double pause = gc_seconds () - start;
+
+  gc->pause += pause;
+
+  if (pause > gc->pause_max)
+    gc->pause_max = pause;
+}
+
+void
+gc_print_statistics (struct gc *gc, FILE *fd)
+{
+  fprintf (fd, "gc collections %zu, freed %zu, pause total %.3f ms, "
+               "max %.3f ms, heap %zu bytes\n",
+           gc->collections, gc->freed, gc->pause * 1e3, gc->pause_max * 1e3,
+           gc->bytes);
+}
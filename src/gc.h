@@ -0,0 +1,52 @@
+#ifndef GC_H
+#define GC_H
+
+#include "environment.h"
+#include "value.h"
+#include <stdio.h>
+
+#define GC_THRESHOLD (1024 * 1024)
+#define GC_GROWTH 2.0
+
+struct vm;
+
+// Mark-sweep collector over the values and environments a VM allocates.
+// The roots are the VM stack (which also holds every temporary and the
+// callee of each frame), the environments of the active frames and the
+// globals. Collections only start in `vm_allocate ()` and when entering a
+// captured function, before the new object exists, so anything else must be
+// on the stack by the next allocation.
+//
+// Vector nodes are shared between arrays and freed by reference counting
+// when the last array using them is swept; each collection traces a node
+// once, which it records by stamping the node with its `epoch`.
+//
+// `bytes` estimates the heap size (the first `nodes` vector nodes created
+// are already counted in it); a collection runs once it exceeds
+// `threshold`, which is then reset to `growth` times what survived, but
+// never below `minimum`.
+struct gc
+{
+  size_t bytes;
+  size_t nodes;
+  size_t threshold;
+  size_t minimum;
+  double growth;
+  size_t epoch;
+
+  struct value **gray;
+  struct environment **gray_environments;
+
+  size_t collections;
+  size_t freed;
+  double pause;
+  double pause_max;
+};
+
+void gc_init (struct gc *gc);
+void gc_destroy (struct gc *gc);
+
+void gc_collect (struct vm *vm);
+void gc_print_statistics (struct gc *gc, FILE *fd);
+
+#endif // GC_H
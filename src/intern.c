@@ -0,0 +1,126 @@
+#include "intern.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_CAPACITY 256
+
+struct entry
+{
+  const char *text;
+  size_t length;
+  size_t hash;
+};
+
+static struct
+{
+  struct arena *arena;
+  struct entry *entries;
+  size_t length;
+  size_t capacity;
+} table;
+
+static size_t
+hash (const char *s, size_t length)
+{
+  size_t hash = 5381;
+
+  for (size_t i = 0; i < length; ++i)
+    hash = ((hash << 5) + hash) + s[i];
+
+  // Similar strings such as numbers hash to neighbouring values; mix the
+  // bits so they do not pile up into long probe runs.
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+static struct entry *
+intern_slot (struct entry *entries, size_t capacity, const char *s,
+             size_t length, size_t hash)
+{
+  size_t mask = capacity - 1;
+
+  for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+      struct entry *entry = &entries[i];
+
+      if (entry->text == NULL)
+        return entry;
+
+      if (entry->hash == hash && entry->length == length
+          && memcmp (entry->text, s, length) == 0)
+        return entry;
+    }
+}
+
+static void
+intern_resize (void)
+{
+  struct entry *old_entries = table.entries;
+  size_t old_capacity = table.capacity;
+
+  table.capacity = table.capacity * 2;
+  table.entries = calloc (table.capacity, sizeof (struct entry));
+
+  for (size_t i = 0; i < old_capacity; ++i)
+    {
+      struct entry *entry = &old_entries[i];
+
+      if (entry->text != NULL)
+        *intern_slot (table.entries, table.capacity, entry->text,
+                      entry->length, entry->hash)
+            = *entry;
+    }
+
+  free (old_entries);
+}
+
+const char *
+intern (const char *s, size_t length)
+{
+  if (table.entries == NULL)
+    {
+      table.arena = arena_create (ARENA_BLOCK_SIZE);
+      table.entries = calloc (INTERN_CAPACITY, sizeof (struct entry));
+      table.capacity = INTERN_CAPACITY;
+    }
+
+  size_t h = hash (s, length);
+  struct entry *entry = intern_slot (table.entries, table.capacity, s,
+                                     length, h);
+
+  if (entry->text != NULL)
+    return entry->text;
+
+  entry->text = arena_copy_string (table.arena, s, length);
+  entry->length = length;
+  entry->hash = h;
+
+  const char *text = entry->text;
+
+  if (++table.length * 4 > table.capacity * 3)
+    intern_resize ();
+
+  return text;
+}
+
+const char *
+intern_string (const char *s)
+{
+  return intern (s, strlen (s));
+}
+
+void
+intern_destroy (void)
+{
+  if (table.entries == NULL)
+    return;
+
+  arena_destroy (table.arena);
+  free (table.entries);
+
+  memset (&table, 0, sizeof (table));
+}
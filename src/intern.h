@@ -0,0 +1,13 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Returns the canonical NUL-terminated copy of `s`. Equal strings intern to
+// the same pointer, so interned strings compare with `==`.
+const char *intern (const char *s, size_t length);
+const char *intern_string (const char *s);
+
+void intern_destroy (void);
+
+#endif // INTERN_H
@@ -1,156 +1,247 @@
 #include "lexer.h"
+#include "array.h"
 #include "common.h"
+#include "intern.h"
 #include "token.h"
-#include <ctype.h>
+#include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <stdio.h>
+static bool
+lexer_refill (struct lexer *lexer)
+{
+  if (lexer->stream == NULL || lexer->eof)
+    return false;
+
+  if (lexer->length + LEXER_CHUNK_SIZE > lexer->capacity)
+    {
+      lexer->capacity = lexer->length + LEXER_CHUNK_SIZE;
+      lexer->buffer = realloc (lexer->buffer, lexer->capacity);
+    }
 
-#define IS_NEWLINE(ch) ((ch) == '\n' || (ch) == '\r')
-#define IS_WHITESPACE(ch) (isblank (ch) || IS_NEWLINE (ch))
-#define IS_SPECIAL(ch) (strchr ("'\"=()[]{}", ch) != NULL)
+  size_t count = fread (&lexer->buffer[lexer->length], sizeof (char),
+                        LEXER_CHUNK_SIZE, lexer->stream);
+
+  if (count == 0)
+    {
+      if (ferror (lexer->stream))
+        error (lexer->line, "cannot read input");
+      lexer->eof = true;
+    }
+
+  lexer->length += count;
+
+  return count > 0;
+}
 
 static void
-lexer_advance (struct lexer *lexer)
+lexer_discard (struct lexer *lexer)
 {
-  lexer->index++;
-  lexer->current = lexer->buffer[lexer->index];
+  if (lexer->stream == NULL || lexer->index < LEXER_CHUNK_SIZE)
+    return;
 
-  if (lexer->current != '\0')
-    lexer->next = lexer->buffer[lexer->index + 1];
+  lexer->discarded += lexer->index;
+  lexer->length -= lexer->index;
+  memmove (lexer->buffer, &lexer->buffer[lexer->index], lexer->length);
+
+  lexer->index = 0;
+}
+
+// The character `distance` bytes past the current one, or '\0' at the end of
+// the input.
+static char
+lexer_char (struct lexer *lexer, size_t distance)
+{
+  size_t index = lexer->index + distance;
+
+  while (index >= lexer->length)
+    if (!lexer_refill (lexer))
+      return '\0';
+
+  return lexer->buffer[index];
+}
+
+// Advances over the run `scan` accepts, reading more of a stream whenever the
+// run reaches the end of the buffer.
+static void
+lexer_run (struct lexer *lexer, size_t (*scan) (const char *, size_t))
+{
+  do
+    if (lexer->index < lexer->length)
+      lexer->index += scan (&lexer->buffer[lexer->index],
+                            lexer->length - lexer->index);
+  while (lexer->index == lexer->length && lexer_refill (lexer));
+}
 
-  if (IS_NEWLINE (lexer->current))
-    lexer->line++;
+static void
+lexer_skip_blank (struct lexer *lexer)
+{
+  do
+    if (lexer->index < lexer->length)
+      lexer->index += lexer->scanner->blank (&lexer->buffer[lexer->index],
+                                             lexer->length - lexer->index,
+                                             &lexer->line);
+  while (lexer->index == lexer->length && lexer_refill (lexer));
 }
 
 static struct token
 lexer_advance_with (struct lexer *lexer, size_t type, size_t advance)
 {
-  size_t line = lexer->line;
+  lexer->index += advance;
 
-  while (advance--)
-    lexer_advance (lexer);
-
-  return token_create (NULL, type, line);
+  return token_create (NULL, 0, type, lexer->line, lexer->start);
 }
 
-static char *
-lexer_copy_value (struct lexer *lexer, size_t begin)
+static struct token
+lexer_token (struct lexer *lexer, size_t begin, size_t type)
 {
-  size_t size = lexer->index - begin;
-  char *value;
+  size_t length = lexer->index - begin;
+  const char *value = &lexer->buffer[begin];
 
-  value = calloc (size + 1, sizeof (char));
-  memcpy (value, &lexer->buffer[begin], size);
+  if (token_type_match (type, 3, TOKEN_IDENTIFIER, TOKEN_SYMBOL,
+                        TOKEN_STRING))
+    value = intern (value, length);
+  else if (!lexer->views)
+    value = arena_copy_string (lexer->arena, value, length);
 
-  return value;
+  return token_create (value, length, type, lexer->line, lexer->start);
 }
 
 static struct token
 lexer_parse_number (struct lexer *lexer)
 {
-  size_t line = lexer->line;
   size_t begin = lexer->index;
   size_t dots = 0;
+  char ch;
 
-  while (isdigit (lexer->current) || lexer->current == '.')
+  while (SCAN_IS (ch = lexer_char (lexer, 0), CLASS_DIGIT) || ch == '.')
     {
-      if (lexer->current == '.' && ++dots > 1)
-        error (line, "malformed floating-point number");
-      lexer_advance (lexer);
+      if (ch == '.' && ++dots > 1)
+        error (lexer->line, "malformed floating-point number");
+      lexer->index++;
     }
 
-  char *value = lexer_copy_value (lexer, begin);
   size_t type = !dots ? TOKEN_INTEGER : TOKEN_FLOAT;
 
-  return token_create (value, type, line);
+  return lexer_token (lexer, begin, type);
 }
 
 static struct token
 lexer_parse_string (struct lexer *lexer)
 {
-  lexer_advance (lexer);
+  size_t begin = ++lexer->index;
 
-  size_t line = lexer->line;
-  size_t begin = lexer->index;
+  lexer_run (lexer, lexer->scanner->string);
 
-  while (lexer->current != '"')
-    {
-      if (IS_NEWLINE (lexer->current) || lexer->current == '\0')
-        error (line, "unterminated string-literal");
-      lexer_advance (lexer);
-    }
+  if (lexer_char (lexer, 0) != '"')
+    error (lexer->line, "unterminated string-literal");
 
-  char *value = lexer_copy_value (lexer, begin);
+  struct token token = lexer_token (lexer, begin, TOKEN_STRING);
 
-  lexer_advance (lexer);
+  lexer->index++;
 
-  return token_create (value, TOKEN_STRING, line);
+  return token;
 }
 
 static struct token
 lexer_parse_word (struct lexer *lexer)
 {
   bool symbol = false;
-  if ((symbol = lexer->current == '\''))
-    lexer_advance (lexer);
+  if ((symbol = lexer_char (lexer, 0) == '\''))
+    lexer->index++;
 
-  size_t line = lexer->line;
   size_t begin = lexer->index;
 
-  while ((ispunct (lexer->current) || isalnum (lexer->current))
-         && !(lexer->current == '=' && lexer->next == '>')
-         && !IS_SPECIAL (lexer->current))
-    lexer_advance (lexer);
+  lexer_run (lexer, lexer->scanner->word);
 
   if (begin == lexer->index)
-    error (line, "expected character");
+    error (lexer->line, "expected character");
 
-  char *value = lexer_copy_value (lexer, begin);
   size_t type = !symbol ? TOKEN_IDENTIFIER : TOKEN_SYMBOL;
 
-  return token_create (value, type, line);
+  return lexer_token (lexer, begin, type);
+}
+
+static struct lexer *
+lexer_start (struct lexer *lexer)
+{
+  lexer->line = 1;
+  lexer->scanner = scanner_get ();
+
+  return lexer;
 }
 
 struct lexer *
-lexer_create (char *buffer)
+lexer_create (char *buffer, size_t length, struct arena *arena, bool views)
 {
   struct lexer *lexer;
 
   lexer = calloc (1, sizeof (struct lexer));
+  lexer->arena = arena;
   lexer->buffer = buffer;
-  lexer->line = 1;
+  lexer->length = length;
+  lexer->views = views;
 
-  if (buffer && *buffer != '\0')
-    {
-      lexer->current = buffer[0];
-      lexer->next = buffer[1];
-    }
+  return lexer_start (lexer);
+}
+
+struct lexer *
+lexer_create_stream (FILE *stream, struct arena *arena)
+{
+  struct lexer *lexer;
 
-  if (IS_NEWLINE (lexer->current))
-    lexer->line++;
+  // Stream buffers are recycled, so tokens always copy their text.
+  lexer = calloc (1, sizeof (struct lexer));
+  lexer->arena = arena;
+  lexer->stream = stream;
 
-  return lexer;
+  return lexer_start (lexer);
 }
 
 void
 lexer_destroy (struct lexer *lexer)
 {
+  if (lexer->stream != NULL)
+    free (lexer->buffer);
+
+  if (lexer->tokens != NULL)
+    array_destroy (lexer->tokens);
+
   free (lexer);
 }
 
-struct token
-lexer_next (struct lexer *lexer)
+// Moves a buffer lexer to byte `offset`, which must not be inside a token,
+// comment or string, and which is on line `line`. Peeked tokens are dropped.
+void
+lexer_seek (struct lexer *lexer, size_t offset, size_t line)
 {
-  for (; lexer->current != '\0'; lexer_advance (lexer))
+  assert (lexer->stream == NULL && lexer->tokens == NULL);
+  assert (offset <= lexer->length);
+
+  lexer->index = offset;
+  lexer->line = line;
+  lexer->head = 0;
+  lexer->count = 0;
+}
+
+static struct token
+lexer_scan (struct lexer *lexer)
+{
+  char current;
+
+  lexer_discard (lexer);
+
+  for (;;)
     {
-      if (IS_WHITESPACE (lexer->current))
-        continue;
+      lexer_skip_blank (lexer);
+      lexer->start = lexer->discarded + lexer->index;
 
-      switch (lexer->current)
+      switch (current = lexer_char (lexer, 0))
         {
+        case '\0':
+          return token_create (NULL, 0, TOKEN_EOF, lexer->line,
+                               lexer->start);
         case '(':
           return lexer_advance_with (lexer, TOKEN_LPAREN, 1);
         case ')':
@@ -164,42 +255,92 @@ lexer_next (struct lexer *lexer)
         case '}':
           return lexer_advance_with (lexer, TOKEN_RBRACE, 1);
         case '=':
-          if (lexer->next == '>')
+          if (lexer_char (lexer, 1) == '>')
             return lexer_advance_with (lexer, TOKEN_ARROW, 2);
           else
             return lexer_advance_with (lexer, TOKEN_EQUALS, 1);
+        case '"':
+          return lexer_parse_string (lexer);
         default:
-          if (lexer->current == '-' && lexer->next == '-')
-            while (!IS_NEWLINE (lexer->current))
-              lexer_advance (lexer);
-          else if (lexer->current == '"')
-            return lexer_parse_string (lexer);
-          else if (isdigit (lexer->current))
+          if (current == '-' && lexer_char (lexer, 1) == '-')
+            lexer_run (lexer, lexer->scanner->line);
+          else if (SCAN_IS (current, CLASS_DIGIT))
             return lexer_parse_number (lexer);
-          else if (ispunct (lexer->current) || isalpha (lexer->current))
+          else if (SCAN_IS (current, CLASS_PUNCT | CLASS_ALPHA))
             return lexer_parse_word (lexer);
           else
-            error (lexer->line, "unexpected character `%c`", lexer->current);
+            error (lexer->line, "unexpected character `%c`", current);
         }
     }
+}
+
+static struct token
+lexer_replay (struct lexer *lexer, size_t distance)
+{
+  size_t last = array_length (lexer->tokens) - 1;
+  size_t index = lexer->replay + distance;
 
-  return token_create (NULL, TOKEN_EOF, lexer->line);
+  return lexer->tokens[index < last ? index : last];
 }
 
 struct token
-lexer_peek (struct lexer *lexer)
+lexer_next (struct lexer *lexer)
 {
-  size_t index = lexer->index;
-  size_t line = lexer->line;
-  bool newline = IS_NEWLINE (lexer->current);
+  if (lexer->tokens != NULL)
+    {
+      struct token token = lexer_replay (lexer, 0);
+
+      if (token.type != TOKEN_EOF)
+        lexer->replay++;
 
-  struct token token = lexer_next (lexer);
+      return token;
+    }
+
+  if (lexer->count == 0)
+    return lexer_scan (lexer);
 
-  lexer->index = index - 1;
-  lexer->line = line - newline;
+  struct token token = lexer->lookahead[lexer->head];
 
-  lexer_advance (lexer);
+  lexer->head = (lexer->head + 1) % LEXER_LOOKAHEAD;
+  lexer->count--;
 
   return token;
 }
 
+struct token
+lexer_peek (struct lexer *lexer, size_t distance)
+{
+  assert (distance < LEXER_LOOKAHEAD);
+
+  if (lexer->tokens != NULL)
+    return lexer_replay (lexer, distance);
+
+  for (; lexer->count <= distance; lexer->count++)
+    {
+      size_t index = (lexer->head + lexer->count) % LEXER_LOOKAHEAD;
+      lexer->lookahead[index] = lexer_scan (lexer);
+    }
+
+  return lexer->lookahead[(lexer->head + distance) % LEXER_LOOKAHEAD];
+}
+
+// Scans the rest of the input at once, so that lexing can be measured apart
+// from parsing. Returns the number of tokens, not counting the end of input.
+size_t
+lexer_tokenize (struct lexer *lexer)
+{
+  struct token *tokens = array_create (1024, sizeof (struct token));
+  struct token token;
+
+  do
+    {
+      token = lexer_next (lexer);
+      array_append (tokens, &token);
+    }
+  while (token.type != TOKEN_EOF);
+
+  lexer->tokens = tokens;
+  lexer->replay = 0;
+
+  return array_length (tokens) - 1;
+}
@@ -1,22 +1,59 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "arena.h"
+#include "scan.h"
 #include "token.h"
+#include <stdio.h>
 
+#define LEXER_CHUNK_SIZE (64 * 1024)
+#define LEXER_LOOKAHEAD 4
+
+// A lexer reads either a complete buffer of `length` bytes, which need not
+// be NUL-terminated (e.g. a mapped file), or a `stream` that is pulled in
+// LEXER_CHUNK_SIZE pieces. Stream buffers only keep the bytes from the
+// current token onwards.
+//
+// Runs of blanks, comments, string bodies and words are consumed by the
+// `scanner` in one call each rather than byte by byte.
+//
+// Peeked tokens are kept in the `lookahead` ring, starting at `head`, until
+// `lexer_next ()` hands them out. After `lexer_tokenize ()` the whole input
+// is in `tokens` and is replayed from there.
+//
+// `discarded` counts the stream bytes dropped from the buffer, and `start`
+// is the offset of the token being scanned.
 struct lexer
 {
+  struct arena *arena;
   char *buffer;
+  size_t length;
+  size_t capacity;
+  FILE *stream;
+  bool eof;
+  bool views;
   size_t index;
   size_t line;
-  char current;
-  char next;
+  size_t discarded;
+  size_t start;
+  const struct scanner *scanner;
+  struct token lookahead[LEXER_LOOKAHEAD];
+  size_t head;
+  size_t count;
+  struct token *tokens;
+  size_t replay;
 };
 
-struct lexer *lexer_create (char *buffer);
+struct lexer *lexer_create (char *buffer, size_t length, struct arena *arena,
+                            bool views);
+struct lexer *lexer_create_stream (FILE *stream, struct arena *arena);
 void lexer_destroy (struct lexer *lexer);
 
+void lexer_seek (struct lexer *lexer, size_t offset, size_t line);
+
 struct token lexer_next (struct lexer *lexer);
-struct token lexer_peek (struct lexer *lexer);
+struct token lexer_peek (struct lexer *lexer, size_t distance);
+size_t lexer_tokenize (struct lexer *lexer);
 
 #endif // LEXER_H
 
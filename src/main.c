@@ -1,83 +1,315 @@
 #include "common.h"
+#include "source.h"
+#include "intern.h"
 #include "lexer.h"
 #include "parser.h"
-#include "evaluator.h"
+#include "resolver.h"
+#include "compiler.h"
+#include "cache.h"
+#include "repl.h"
+#include "vm.h"
 #include "array.h"
+#include "shape.h"
+#include "vector.h"
 
+#include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <sys/resource.h>
 #include <time.h>
+#include <unistd.h>
 
-char *
-read_file(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL) {
-        perror("Error opening file");
-        return NULL;
-    }
+enum
+{
+  PHASE_READ,
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_STORE,
+  PHASE_COMPILE,
+  PHASE_EVALUATE,
+  PHASE_TEARDOWN,
+  PHASE_COUNT
+};
 
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+struct phase
+{
+  const char *name;
+  double wall;
+  double cpu;
+};
 
-    char* buffer = (char*)malloc(file_size + 1);
-    if (buffer == NULL) {
-        perror("Memory allocation failed");
-        fclose(file);
-        return NULL;
-    }
+static struct phase phases[PHASE_COUNT] = {
+  { "read", 0, 0 },
+  { "lex", 0, 0 },
+  { "parse", 0, 0 },
+  { "store", 0, 0 },
+  { "compile", 0, 0 },
+  { "evaluate", 0, 0 },
+  { "teardown", 0, 0 }
+};
 
-    size_t bytes_read = fread(buffer, 1, file_size, file);
-    if (bytes_read != file_size) {
-        perror("Error reading the file");
-        free(buffer);
-        fclose(file);
-        return NULL;
-    }
+static double
+seconds (clockid_t clock)
+{
+  struct timespec now;
+
+  clock_gettime (clock, &now);
+
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void
+phase_start (size_t phase)
+{
+  phases[phase].wall -= seconds (CLOCK_MONOTONIC);
+  phases[phase].cpu -= seconds (CLOCK_PROCESS_CPUTIME_ID);
+}
+
+static void
+phase_stop (size_t phase)
+{
+  phases[phase].wall += seconds (CLOCK_MONOTONIC);
+  phases[phase].cpu += seconds (CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// Standard input is read while it is lexed, so its reading time is part of
+// the lexer's. Without `--stats` lexing happens during parsing. Loading a
+// cached tree is part of reading, and writing one is its own phase.
+static void
+print_statistics (size_t tokens, size_t nodes, size_t values, size_t shapes,
+                  FILE *fd)
+{
+  const struct hash_table_statistics *tables = hash_table_statistics ();
+  struct rusage usage;
+
+  fprintf (fd, "%-10s %12s %12s\n", "phase", "wall ms", "cpu ms");
+
+  for (size_t i = 0; i < PHASE_COUNT; ++i)
+    fprintf (fd, "%-10s %12.3f %12.3f\n", phases[i].name,
+             phases[i].wall * 1e3, phases[i].cpu * 1e3);
 
-    buffer[file_size] = '\0';
+  getrusage (RUSAGE_SELF, &usage);
 
-    fclose(file);
-    return buffer;
+  fprintf (fd, "tokens %zu\n", tokens);
+  fprintf (fd, "ast nodes %zu\n", nodes);
+  fprintf (fd, "values %zu\n", values);
+  fprintf (fd, "vector nodes %zu\n", vector_count ());
+  fprintf (fd, "shapes %zu\n", shapes);
+  fprintf (fd, "hash tables %zu, slots %zu, insertions %zu\n",
+           tables->tables, tables->slots, tables->insertions);
+  fprintf (fd, "peak rss %ld KiB\n", usage.ru_maxrss);
+}
+
+static _Noreturn void
+usage (const char *program)
+{
+  fprintf (stderr,
+           "usage: %s [-d] [-b] [-i] [--stats] [--gc-threshold bytes] "
+           "[--gc-growth factor] [--cache directory] [file | -]\n",
+           program);
+  exit (EXIT_FAILURE);
+}
+
+static struct vm *
+create_vm (long threshold, double growth)
+{
+  struct vm *vm = vm_create ();
+
+  if (threshold >= 0)
+    vm->gc.threshold = vm->gc.minimum = threshold;
+
+  if (growth > 0)
+    vm->gc.growth = growth;
+
+  return vm;
+}
+
+// Reads statements from standard input until it ends, prompting when it is
+// a terminal.
+static struct repl *
+interact (struct vm *vm)
+{
+  struct repl *repl = repl_create (vm);
+
+  repl_run (repl, stdin, isatty (STDIN_FILENO));
+
+  return repl;
 }
 
 int
 main (int argc, char *argv[])
 {
-  struct lexer *lexer;
-  struct parser *parser;
+  struct source *source = NULL;
+  struct arena *arena;
+  struct lexer *lexer = NULL;
+  struct parser *parser = NULL;
+  struct ast *ast = NULL;
+  struct function *function;
+  struct vm *vm;
+  struct repl *repl = NULL;
 
-  char *source = read_file ("tests/syntax.txt");
+  const char *path = NULL;
+  const char *cache = NULL;
+  bool debug = false;
+  bool disassemble = false;
+  bool statistics = false;
+  bool interactive = false;
+  long threshold = -1;
+  double growth = 0;
 
-  lexer = lexer_create (source);
-  parser = parser_create (lexer);
+  size_t tokens = 0;
+  size_t nodes = 0;
 
-  struct ast *ast = parser_parse (parser);
+  for (int i = 1; i < argc; ++i)
+    if (strcmp (argv[i], "-d") == 0)
+      debug = true;
+    else if (strcmp (argv[i], "-b") == 0)
+      disassemble = true;
+    else if (strcmp (argv[i], "-i") == 0)
+      interactive = true;
+    else if (strcmp (argv[i], "--stats") == 0)
+      statistics = true;
+    else if (strcmp (argv[i], "--gc-threshold") == 0 && i + 1 < argc)
+      threshold = atol (argv[++i]);
+    else if (strcmp (argv[i], "--gc-growth") == 0 && i + 1 < argc)
+      growth = atof (argv[++i]);
+    else if (strcmp (argv[i], "--cache") == 0 && i + 1 < argc)
+      cache = argv[++i];
+    else if (path == NULL)
+      path = argv[i];
+    else
+      usage (argv[0]);
 
-  if (argc >= 2 && strcmp (argv[1], "-d") == 0)
-    ast_print_debug (ast, 0);
+  // Without a script, `-i` starts from an empty environment.
+  if (interactive && path == NULL)
+    {
+      vm = create_vm (threshold, growth);
+      repl = interact (vm);
 
-  struct value *value = evaluate (ast);
+      vm_destroy (vm);
+      repl_destroy (repl);
+      intern_destroy ();
+      shape_destroy_all ();
 
-  printf ("PROGRAM RETURNED:\n");
+      return 0;
+    }
+
+  phase_start (PHASE_READ);
 
-  if (value != NULL)
+  arena = arena_create (ARENA_BLOCK_SIZE);
+
+  // Files are mapped and lexed in place; standard input and pipes are
+  // streamed through the lexer in chunks.
+  if (path == NULL || strcmp (path, "-") == 0)
+    lexer = lexer_create_stream (stdin, arena);
+  else
     {
-      value_print (value, stdout);
-      printf ("\n");
+      if ((source = source_open (path)) == NULL)
+        return EXIT_FAILURE;
+
+      // A cached tree of the same source needs no lexing or parsing.
+      if (cache != NULL)
+        ast = cache_load (cache, source->buffer, source->length);
+
+      if (ast == NULL)
+        lexer = lexer_create (source->buffer, source->length, arena, true);
+    }
+
+  phase_stop (PHASE_READ);
+
+  if (lexer != NULL)
+    {
+      if (statistics)
+        {
+          phase_start (PHASE_LEX);
+          tokens = lexer_tokenize (lexer);
+          phase_stop (PHASE_LEX);
+        }
+
+      phase_start (PHASE_PARSE);
+
+      parser = parser_create (lexer);
+      ast = parser_parse (parser);
+
+      phase_stop (PHASE_PARSE);
+
+      if (cache != NULL && source != NULL)
+        {
+          phase_start (PHASE_STORE);
+          cache_store (cache, source->buffer, source->length, ast);
+          phase_stop (PHASE_STORE);
+        }
     }
 
-  value_destroy (value);
+  if (statistics)
+    nodes = ast_count (ast);
+
+  if (debug)
+    ast_print_debug (ast, ast->root, 0);
+
+  phase_start (PHASE_COMPILE);
+
+  resolve (ast, arena);
+
+  function = compile (ast);
+
+  phase_stop (PHASE_COMPILE);
+
+  if (disassemble)
+    function_disassemble (function, stdout);
+
+  phase_start (PHASE_EVALUATE);
 
+  vm = create_vm (threshold, growth);
+
+  value_t value = vm_run (vm, function);
+
+  phase_stop (PHASE_EVALUATE);
+
+  printf ("PROGRAM RETURNED:\n");
+
+  value_print (value, stdout);
+  printf ("\n");
+
+  if (statistics)
+    vm_print_statistics (vm, stderr);
+
+  // The script's globals stay defined for the statements that follow.
+  if (interactive)
+    repl = interact (vm);
+
+  size_t values = value_count ();
+  size_t shapes = shape_count ();
+
+  phase_start (PHASE_TEARDOWN);
+
+  vm_destroy (vm);
+  function_destroy (function);
+
+  if (repl != NULL)
+    repl_destroy (repl);
   ast_destroy (ast);
 
-  parser_destroy (parser);
-  lexer_destroy (lexer);
+  if (lexer != NULL)
+    {
+      parser_destroy (parser);
+      lexer_destroy (lexer);
+    }
+
+  arena_destroy (arena);
 
-  free (source);
+  if (source != NULL)
+    source_close (source);
+
+  intern_destroy ();
+  shape_destroy_all ();
+
+  phase_stop (PHASE_TEARDOWN);
+
+  if (statistics)
+    print_statistics (tokens, nodes, values, shapes, stderr);
 
   return 0;
 }
-
@@ -0,0 +1,668 @@
+#include "numeric.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NUMERIC_X86 1
+#endif
+
+// Integer arithmetic goes through uint32_t, where wrapping around is
+// defined.
+static inline int32_t
+wrap (uint32_t value)
+{
+  return (int32_t)value;
+}
+
+static unsigned
+scalar_tags (const value_t *items, size_t n)
+{
+  unsigned tags = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    tags |= 1u << VALUE_TAG (items[i]);
+
+  return tags;
+}
+
+static uint32_t
+scalar_truthy (const value_t *items, size_t n)
+{
+  uint32_t mask = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    {
+      bool truthy;
+
+      switch (VALUE_TAG (items[i]))
+        {
+        case TAG_INTEGER:
+          truthy = value_as_integer (items[i]) != 0;
+          break;
+        case TAG_FLOAT:
+          truthy = value_as_float (items[i]) != 0;
+          break;
+        case TAG_VOID:
+          truthy = false;
+          break;
+        default:
+          truthy = true;
+        }
+
+      mask |= (uint32_t)truthy << i;
+    }
+
+  return mask;
+}
+
+static int32_t
+scalar_sum_integers (const value_t *items, size_t n)
+{
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    sum += value_as_integer (items[i]);
+
+  return wrap (sum);
+}
+
+static float
+scalar_sum_floats (const value_t *items, size_t n)
+{
+  float sum = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    sum += value_as_float (items[i]);
+
+  return sum;
+}
+
+static int32_t
+scalar_dot_integers (const value_t *a, const value_t *b, size_t n)
+{
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    sum += (uint32_t)value_as_integer (a[i])
+           * (uint32_t)value_as_integer (b[i]);
+
+  return wrap (sum);
+}
+
+static float
+scalar_dot_floats (const value_t *a, const value_t *b, size_t n)
+{
+  float sum = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    sum += value_as_float (a[i]) * value_as_float (b[i]);
+
+  return sum;
+}
+
+// Only narrows `*min` and `*max`, which the caller starts from an item.
+static void
+scalar_range_integers (const value_t *items, size_t n, int32_t *min,
+                       int32_t *max)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      int32_t item = value_as_integer (items[i]);
+
+      *min = item < *min ? item : *min;
+      *max = item > *max ? item : *max;
+    }
+}
+
+static void
+scalar_range_floats (const value_t *items, size_t n, float *min, float *max)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      float item = value_as_float (items[i]);
+
+      *min = item < *min ? item : *min;
+      *max = item > *max ? item : *max;
+    }
+}
+
+static void
+scalar_combine_integers (const value_t *a, const value_t *b, size_t n,
+                         int operation, value_t *out)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      uint32_t x = value_as_integer (a[i]);
+      uint32_t y = value_as_integer (b[i]);
+
+      out[i] = value_integer (wrap (operation == NUMERIC_ADD ? x + y : x * y));
+    }
+}
+
+static void
+scalar_combine_floats (const value_t *a, const value_t *b, size_t n,
+                       int operation, value_t *out)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      float x = value_as_float (a[i]);
+      float y = value_as_float (b[i]);
+
+      out[i] = value_float (operation == NUMERIC_ADD ? x + y : x * y);
+    }
+}
+
+static void
+scalar_scale_integers (const value_t *items, size_t n, int32_t factor,
+                       value_t *out)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = value_integer (
+        wrap ((uint32_t)value_as_integer (items[i]) * (uint32_t)factor));
+}
+
+static void
+scalar_scale_floats (const value_t *items, size_t n, float factor,
+                     value_t *out)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = value_float (value_as_float (items[i]) * factor);
+}
+
+static int32_t
+scalar_prefix_integers (const value_t *items, size_t n, int32_t carry,
+                        value_t *out)
+{
+  uint32_t sum = carry;
+
+  for (size_t i = 0; i < n; ++i)
+    {
+      sum += value_as_integer (items[i]);
+      out[i] = value_integer (wrap (sum));
+    }
+
+  return wrap (sum);
+}
+
+static float
+scalar_prefix_floats (const value_t *items, size_t n, float carry,
+                      value_t *out)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      carry += value_as_float (items[i]);
+      out[i] = value_float (carry);
+    }
+
+  return carry;
+}
+
+static const struct numeric SCALAR = {
+  "scalar",
+  scalar_tags,
+  scalar_truthy,
+  scalar_sum_integers,
+  scalar_sum_floats,
+  scalar_dot_integers,
+  scalar_dot_floats,
+  scalar_range_integers,
+  scalar_range_floats,
+  scalar_combine_integers,
+  scalar_combine_floats,
+  scalar_scale_integers,
+  scalar_scale_floats,
+  scalar_prefix_integers,
+  scalar_prefix_floats
+};
+
+#ifdef NUMERIC_X86
+
+// The AVX2 kernels handle eight items at a time and leave the rest to the
+// scalar ones. Each item is a 64-bit word with its tag in the low half and
+// its payload in the high half, so one shuffle gathers eight payloads into
+// a register, in the order 0 1 4 5 2 3 6 7 within it. Reductions do not
+// mind the order, and unpacking them next to their tags undoes it.
+
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+
+TARGET_AVX2 static inline __m256i
+avx2_load (const value_t *items)
+{
+  __m256 low = _mm256_loadu_ps ((const float *)items);
+  __m256 high = _mm256_loadu_ps ((const float *)(items + 4));
+
+  return _mm256_castps_si256 (
+      _mm256_shuffle_ps (low, high, _MM_SHUFFLE (3, 1, 3, 1)));
+}
+
+TARGET_AVX2 static inline __m256i
+avx2_load_tags (const value_t *items)
+{
+  __m256 low = _mm256_loadu_ps ((const float *)items);
+  __m256 high = _mm256_loadu_ps ((const float *)(items + 4));
+  __m256i tags = _mm256_castps_si256 (
+      _mm256_shuffle_ps (low, high, _MM_SHUFFLE (2, 0, 2, 0)));
+
+  return _mm256_and_si256 (tags, _mm256_set1_epi32 (TAG_MASK));
+}
+
+TARGET_AVX2 static inline void
+avx2_store (value_t *out, __m256i payloads, int tag)
+{
+  __m256i tags = _mm256_set1_epi32 (tag);
+
+  _mm256_storeu_si256 ((__m256i *)out, _mm256_unpacklo_epi32 (tags, payloads));
+  _mm256_storeu_si256 ((__m256i *)(out + 4),
+                       _mm256_unpackhi_epi32 (tags, payloads));
+}
+
+// Puts loaded payloads in item order, and back.
+TARGET_AVX2 static inline __m256i
+avx2_order (__m256i payloads)
+{
+  return _mm256_permute4x64_epi64 (payloads, _MM_SHUFFLE (3, 1, 2, 0));
+}
+
+TARGET_AVX2 static inline __m128i
+avx2_fold (__m256i x)
+{
+  return _mm_add_epi32 (_mm256_castsi256_si128 (x),
+                        _mm256_extracti128_si256 (x, 1));
+}
+
+TARGET_AVX2 static inline int32_t
+avx2_sum_epi32 (__m256i x)
+{
+  __m128i sum = avx2_fold (x);
+
+  sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, _MM_SHUFFLE (1, 0, 3, 2)));
+  sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, _MM_SHUFFLE (2, 3, 0, 1)));
+
+  return _mm_cvtsi128_si32 (sum);
+}
+
+TARGET_AVX2 static inline float
+avx2_sum_ps (__m256 x)
+{
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (x),
+                           _mm256_extractf128_ps (x, 1));
+
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+
+  return _mm_cvtss_f32 (sum);
+}
+
+TARGET_AVX2 static unsigned
+avx2_tags (const value_t *items, size_t n)
+{
+  __m256i seen = _mm256_setzero_si256 ();
+  __m256i one = _mm256_set1_epi32 (1);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    seen = _mm256_or_si256 (
+        seen, _mm256_sllv_epi32 (one, avx2_load_tags (&items[i])));
+
+  __m128i tags = _mm_or_si128 (_mm256_castsi256_si128 (seen),
+                               _mm256_extracti128_si256 (seen, 1));
+
+  tags = _mm_or_si128 (tags,
+                       _mm_shuffle_epi32 (tags, _MM_SHUFFLE (1, 0, 3, 2)));
+  tags = _mm_or_si128 (tags,
+                       _mm_shuffle_epi32 (tags, _MM_SHUFFLE (2, 3, 0, 1)));
+
+  return _mm_cvtsi128_si32 (tags) | scalar_tags (&items[i], n - i);
+}
+
+// Integers are false when zero, floats when zero after dropping the sign,
+// and void always.
+TARGET_AVX2 static uint32_t
+avx2_truthy (const value_t *items, size_t n)
+{
+  uint32_t mask = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i tags = avx2_load_tags (&items[i]);
+      __m256i payloads = avx2_load (&items[i]);
+      __m256i zero = _mm256_setzero_si256 ();
+      __m256i integer = _mm256_and_si256 (
+          _mm256_cmpeq_epi32 (tags, _mm256_set1_epi32 (TAG_INTEGER)),
+          _mm256_cmpeq_epi32 (payloads, zero));
+      __m256i floating = _mm256_and_si256 (
+          _mm256_cmpeq_epi32 (tags, _mm256_set1_epi32 (TAG_FLOAT)),
+          _mm256_cmpeq_epi32 (
+              _mm256_and_si256 (payloads, _mm256_set1_epi32 (0x7fffffff)),
+              zero));
+      __m256i falsy = _mm256_or_si256 (
+          _mm256_or_si256 (integer, floating),
+          _mm256_cmpeq_epi32 (tags, _mm256_set1_epi32 (TAG_VOID)));
+
+      falsy = avx2_order (falsy);
+      mask |= (uint32_t)(~_mm256_movemask_ps (_mm256_castsi256_ps (falsy))
+                         & 0xff)
+              << i;
+    }
+
+  // A full 32 items leave nothing to shift in.
+  if (i < n)
+    mask |= scalar_truthy (&items[i], n - i) << i;
+
+  return mask;
+}
+
+TARGET_AVX2 static int32_t
+avx2_sum_integers (const value_t *items, size_t n)
+{
+  __m256i sum = _mm256_setzero_si256 ();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    sum = _mm256_add_epi32 (sum, avx2_load (&items[i]));
+
+  return wrap ((uint32_t)avx2_sum_epi32 (sum)
+               + (uint32_t)scalar_sum_integers (&items[i], n - i));
+}
+
+TARGET_AVX2 static float
+avx2_sum_floats (const value_t *items, size_t n)
+{
+  __m256 sum = _mm256_setzero_ps ();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    sum = _mm256_add_ps (sum, _mm256_castsi256_ps (avx2_load (&items[i])));
+
+  return avx2_sum_ps (sum) + scalar_sum_floats (&items[i], n - i);
+}
+
+TARGET_AVX2 static int32_t
+avx2_dot_integers (const value_t *a, const value_t *b, size_t n)
+{
+  __m256i sum = _mm256_setzero_si256 ();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    sum = _mm256_add_epi32 (
+        sum, _mm256_mullo_epi32 (avx2_load (&a[i]), avx2_load (&b[i])));
+
+  return wrap ((uint32_t)avx2_sum_epi32 (sum)
+               + (uint32_t)scalar_dot_integers (&a[i], &b[i], n - i));
+}
+
+TARGET_AVX2 static float
+avx2_dot_floats (const value_t *a, const value_t *b, size_t n)
+{
+  __m256 sum = _mm256_setzero_ps ();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    sum = _mm256_add_ps (
+        sum, _mm256_mul_ps (_mm256_castsi256_ps (avx2_load (&a[i])),
+                            _mm256_castsi256_ps (avx2_load (&b[i]))));
+
+  return avx2_sum_ps (sum) + scalar_dot_floats (&a[i], &b[i], n - i);
+}
+
+TARGET_AVX2 static void
+avx2_range_integers (const value_t *items, size_t n, int32_t *min,
+                     int32_t *max)
+{
+  __m256i low = _mm256_set1_epi32 (*min);
+  __m256i high = _mm256_set1_epi32 (*max);
+  int32_t lows[8];
+  int32_t highs[8];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i x = avx2_load (&items[i]);
+
+      low = _mm256_min_epi32 (low, x);
+      high = _mm256_max_epi32 (high, x);
+    }
+
+  _mm256_storeu_si256 ((__m256i *)lows, low);
+  _mm256_storeu_si256 ((__m256i *)highs, high);
+
+  for (size_t j = 0; j < 8; ++j)
+    {
+      *min = lows[j] < *min ? lows[j] : *min;
+      *max = highs[j] > *max ? highs[j] : *max;
+    }
+
+  scalar_range_integers (&items[i], n - i, min, max);
+}
+
+TARGET_AVX2 static void
+avx2_range_floats (const value_t *items, size_t n, float *min, float *max)
+{
+  __m256 low = _mm256_set1_ps (*min);
+  __m256 high = _mm256_set1_ps (*max);
+  float lows[8];
+  float highs[8];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256 x = _mm256_castsi256_ps (avx2_load (&items[i]));
+
+      // Unordered lanes take the second operand, so a NaN item is skipped
+      // as it is by the scalar comparisons.
+      low = _mm256_min_ps (x, low);
+      high = _mm256_max_ps (x, high);
+    }
+
+  _mm256_storeu_ps (lows, low);
+  _mm256_storeu_ps (highs, high);
+
+  for (size_t j = 0; j < 8; ++j)
+    {
+      *min = lows[j] < *min ? lows[j] : *min;
+      *max = highs[j] > *max ? highs[j] : *max;
+    }
+
+  scalar_range_floats (&items[i], n - i, min, max);
+}
+
+TARGET_AVX2 static void
+avx2_combine_integers (const value_t *a, const value_t *b, size_t n,
+                       int operation, value_t *out)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i x = avx2_load (&a[i]);
+      __m256i y = avx2_load (&b[i]);
+
+      avx2_store (&out[i],
+                  operation == NUMERIC_ADD ? _mm256_add_epi32 (x, y)
+                                           : _mm256_mullo_epi32 (x, y),
+                  TAG_INTEGER);
+    }
+
+  scalar_combine_integers (&a[i], &b[i], n - i, operation, &out[i]);
+}
+
+TARGET_AVX2 static void
+avx2_combine_floats (const value_t *a, const value_t *b, size_t n,
+                     int operation, value_t *out)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256 x = _mm256_castsi256_ps (avx2_load (&a[i]));
+      __m256 y = _mm256_castsi256_ps (avx2_load (&b[i]));
+      __m256 z = operation == NUMERIC_ADD ? _mm256_add_ps (x, y)
+                                          : _mm256_mul_ps (x, y);
+
+      avx2_store (&out[i], _mm256_castps_si256 (z), TAG_FLOAT);
+    }
+
+  scalar_combine_floats (&a[i], &b[i], n - i, operation, &out[i]);
+}
+
+TARGET_AVX2 static void
+avx2_scale_integers (const value_t *items, size_t n, int32_t factor,
+                     value_t *out)
+{
+  __m256i scale = _mm256_set1_epi32 (factor);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    avx2_store (&out[i], _mm256_mullo_epi32 (avx2_load (&items[i]), scale),
+                TAG_INTEGER);
+
+  scalar_scale_integers (&items[i], n - i, factor, &out[i]);
+}
+
+TARGET_AVX2 static void
+avx2_scale_floats (const value_t *items, size_t n, float factor,
+                   value_t *out)
+{
+  __m256 scale = _mm256_set1_ps (factor);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256 x = _mm256_castsi256_ps (avx2_load (&items[i]));
+
+      avx2_store (&out[i], _mm256_castps_si256 (_mm256_mul_ps (x, scale)),
+                  TAG_FLOAT);
+    }
+
+  scalar_scale_floats (&items[i], n - i, factor, &out[i]);
+}
+
+// Prefix sums of eight items take three steps: within each half, shifted
+// by one and by two items, and then the last sum of the low half carried
+// into the high half.
+TARGET_AVX2 static int32_t
+avx2_prefix_integers (const value_t *items, size_t n, int32_t carry,
+                      value_t *out)
+{
+  __m256i total = _mm256_set1_epi32 (carry);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i x = avx2_order (avx2_load (&items[i]));
+
+      x = _mm256_add_epi32 (x, _mm256_slli_si256 (x, 4));
+      x = _mm256_add_epi32 (x, _mm256_slli_si256 (x, 8));
+      x = _mm256_add_epi32 (
+          x, _mm256_blend_epi32 (
+                 _mm256_setzero_si256 (),
+                 _mm256_permutevar8x32_epi32 (x, _mm256_set1_epi32 (3)),
+                 0xf0));
+      x = _mm256_add_epi32 (x, total);
+      total = _mm256_permutevar8x32_epi32 (x, _mm256_set1_epi32 (7));
+
+      avx2_store (&out[i], avx2_order (x), TAG_INTEGER);
+    }
+
+  return scalar_prefix_integers (&items[i], n - i,
+                                 _mm256_cvtsi256_si32 (total), &out[i]);
+}
+
+TARGET_AVX2 static float
+avx2_prefix_floats (const value_t *items, size_t n, float carry,
+                    value_t *out)
+{
+  __m256 total = _mm256_set1_ps (carry);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i y = avx2_order (avx2_load (&items[i]));
+      __m256 x = _mm256_castsi256_ps (y);
+
+      x = _mm256_add_ps (
+          x, _mm256_castsi256_ps (_mm256_slli_si256 (_mm256_castps_si256 (x),
+                                                     4)));
+      x = _mm256_add_ps (
+          x, _mm256_castsi256_ps (_mm256_slli_si256 (_mm256_castps_si256 (x),
+                                                     8)));
+      x = _mm256_add_ps (
+          x, _mm256_blend_ps (_mm256_setzero_ps (),
+                              _mm256_permutevar8x32_ps (
+                                  x, _mm256_set1_epi32 (3)),
+                              0xf0));
+      x = _mm256_add_ps (x, total);
+      total = _mm256_permutevar8x32_ps (x, _mm256_set1_epi32 (7));
+
+      avx2_store (&out[i], avx2_order (_mm256_castps_si256 (x)), TAG_FLOAT);
+    }
+
+  return scalar_prefix_floats (&items[i], n - i, _mm256_cvtss_f32 (total),
+                               &out[i]);
+}
+
+static const struct numeric AVX2 = {
+  "avx2",
+  avx2_tags,
+  avx2_truthy,
+  avx2_sum_integers,
+  avx2_sum_floats,
+  avx2_dot_integers,
+  avx2_dot_floats,
+  avx2_range_integers,
+  avx2_range_floats,
+  avx2_combine_integers,
+  avx2_combine_floats,
+  avx2_scale_integers,
+  avx2_scale_floats,
+  avx2_prefix_integers,
+  avx2_prefix_floats
+};
+
+#endif
+
+static const struct numeric *available[3];
+static const struct numeric *current;
+
+const struct numeric *const *
+numeric_available (void)
+{
+  if (available[0] != NULL)
+    return available;
+
+  size_t count = 0;
+
+#ifdef NUMERIC_X86
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+    available[count++] = &AVX2;
+#endif
+
+  available[count++] = &SCALAR;
+
+  return available;
+}
+
+const struct numeric *
+numeric_get (void)
+{
+  if (current == NULL)
+    current = numeric_available ()[0];
+
+  return current;
+}
+
+bool
+numeric_select (const char *name)
+{
+  for (const struct numeric *const *n = numeric_available (); *n; ++n)
+    if (strcmp ((*n)->name, name) == 0)
+      {
+        current = *n;
+        return true;
+      }
+
+  return false;
+}
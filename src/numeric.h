@@ -0,0 +1,62 @@
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include "value.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMERIC_INTEGERS (1u << TAG_INTEGER)
+#define NUMERIC_FLOATS (1u << TAG_FLOAT)
+#define NUMERIC_NUMBERS (NUMERIC_INTEGERS | NUMERIC_FLOATS)
+
+enum
+{
+  NUMERIC_ADD,
+  NUMERIC_MULTIPLY
+};
+
+// Kernels over runs of tagged values, such as the leaves `vector_chunk ()`
+// returns, which work on the 32-bit payloads in place. `tags` returns the
+// set of 1 << tag of the items, and `truthy` a bit mask of which of them
+// (at most 32) are true. The others expect items that are all integers or
+// all floats; integers wrap around, and floats are summed in an unspecified
+// order.
+// Results are stored to `out` as tagged values.
+struct numeric
+{
+  const char *name;
+  unsigned (*tags) (const value_t *items, size_t n);
+  uint32_t (*truthy) (const value_t *items, size_t n);
+
+  int32_t (*sum_integers) (const value_t *items, size_t n);
+  float (*sum_floats) (const value_t *items, size_t n);
+  int32_t (*dot_integers) (const value_t *a, const value_t *b, size_t n);
+  float (*dot_floats) (const value_t *a, const value_t *b, size_t n);
+  void (*range_integers) (const value_t *items, size_t n, int32_t *min,
+                          int32_t *max);
+  void (*range_floats) (const value_t *items, size_t n, float *min,
+                        float *max);
+
+  void (*combine_integers) (const value_t *a, const value_t *b, size_t n,
+                            int operation, value_t *out);
+  void (*combine_floats) (const value_t *a, const value_t *b, size_t n,
+                          int operation, value_t *out);
+  void (*scale_integers) (const value_t *items, size_t n, int32_t factor,
+                          value_t *out);
+  void (*scale_floats) (const value_t *items, size_t n, float factor,
+                        value_t *out);
+
+  // Running sums starting from `carry`; they return the last one.
+  int32_t (*prefix_integers) (const value_t *items, size_t n, int32_t carry,
+                              value_t *out);
+  float (*prefix_floats) (const value_t *items, size_t n, float carry,
+                          value_t *out);
+};
+
+// Chosen like the lexer's scanners (see scan.h).
+const struct numeric *numeric_get (void);
+bool numeric_select (const char *name);
+const struct numeric *const *numeric_available (void);
+
+#endif // NUMERIC_H
@@ -1,8 +1,14 @@
 #include "parser.h"
+#include "array.h"
 #include "common.h"
+#include "intern.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
-typedef struct ast *(parse_function_t)(struct parser *);
+typedef node_t (parse_function_t)(struct parser *);
 
 static void
 parser_advance (struct parser *parser)
@@ -25,43 +31,44 @@ parser_advance_match (struct parser *parser, size_t type)
 }
 
 static void
-parser_append_until (struct parser *parser, struct ast *node, size_t type,
+parser_append_until (struct parser *parser, node_t node, size_t type,
                      parse_function_t parse_function, bool initial)
 {
   if (initial)
-    ast_append (node, parse_function (parser));
+    ast_append (parser->ast, node, parse_function (parser));
 
   while (!token_type_match (parser->current.type, 2, type, TOKEN_EOF))
-    ast_append (node, parse_function (parser));
+    ast_append (parser->ast, node, parse_function (parser));
 }
 
-static struct ast *parser_parse_statement (struct parser *parser);
-static struct ast *parser_parse_expression (struct parser *parser);
+static node_t parser_parse_statement (struct parser *parser);
+static node_t parser_parse_expression (struct parser *parser);
 
-static struct ast *parser_parse_declaration (struct parser *parser);
-static struct ast *parser_parse_function (struct parser *parser);
-static struct ast *parser_parse_array (struct parser *parser);
-static struct ast *parser_parse_structure (struct parser *parser);
+static node_t parser_parse_declaration (struct parser *parser);
+static node_t parser_parse_function (struct parser *parser);
+static node_t parser_parse_array (struct parser *parser);
+static node_t parser_parse_structure (struct parser *parser);
 
-static struct ast *parser_parse_number (struct parser *parser);
-static struct ast *parser_parse_string (struct parser *parser);
-static struct ast *parser_parse_identifier (struct parser *parser);
-static struct ast *parser_parse_symbol (struct parser *parser);
+static node_t parser_parse_number (struct parser *parser);
+static node_t parser_parse_string (struct parser *parser);
+static node_t parser_parse_identifier (struct parser *parser);
+static node_t parser_parse_symbol (struct parser *parser);
 
-static struct ast *
+// Parses the statements of a function body.
+static node_t
 parser_parse_program (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
   size_t line = parser->current.line;
 
-  result = ast_create (AST_PROGRAM, line);
+  result = ast_add (parser->ast, AST_PROGRAM, line);
   parser_append_until (parser, result, TOKEN_RPAREN, parser_parse_statement,
                        false);
 
   return result;
 }
 
-static struct ast *
+static node_t
 parser_parse_statement (struct parser *parser)
 {
   size_t type = parser->current.type;
@@ -69,14 +76,14 @@ parser_parse_statement (struct parser *parser)
 
   if (token_type_match (type, 1, TOKEN_ARROW))
     {
-      struct ast *result;
-      struct ast *expression;
+      node_t result;
+      node_t expression;
 
       parser_advance (parser);
       expression = parser_parse_expression (parser);
 
-      result = ast_create (AST_RETURN, line);
-      ast_append (result, expression);
+      result = ast_add (parser->ast, AST_RETURN, line);
+      ast_append (parser->ast, result, expression);
 
       return result;
     }
@@ -84,7 +91,7 @@ parser_parse_statement (struct parser *parser)
   return parser_parse_expression (parser);
 }
 
-static struct ast *
+static node_t
 parser_parse_expression (struct parser *parser)
 {
   size_t type = parser->current.type;
@@ -101,9 +108,7 @@ parser_parse_expression (struct parser *parser)
     return parser_parse_string (parser);
   else if (token_type_match (type, 1, TOKEN_IDENTIFIER))
     {
-      struct token peek = lexer_peek (parser->lexer);
-      if (peek.value != NULL)
-        free (peek.value);
+      struct token peek = lexer_peek (parser->lexer, 0);
 
       if (token_type_match (peek.type, 1, TOKEN_EQUALS))
         return parser_parse_declaration (parser);
@@ -115,12 +120,12 @@ parser_parse_expression (struct parser *parser)
   error (parser->current.line, "expected expression");
 }
 
-static struct ast *
+static node_t
 parser_parse_declaration (struct parser *parser)
 {
-  struct ast *result;
-  struct ast *identifier;
-  struct ast *expression;
+  node_t result;
+  node_t identifier;
+  node_t expression;
   size_t line = parser->current.line;
 
   identifier = parser_parse_identifier (parser);
@@ -129,17 +134,18 @@ parser_parse_declaration (struct parser *parser)
 
   expression = parser_parse_expression (parser);
 
-  result = ast_create (AST_VARIABLE_DECLARATION, line);
-  ast_append (result, identifier);
-  ast_append (result, expression);
+  result = ast_add (parser->ast, AST_VARIABLE_DECLARATION, line);
+  ast_add_payload (parser->ast, result);
+  ast_append (parser->ast, result, identifier);
+  ast_append (parser->ast, result, expression);
 
   return result;
 }
 
-static struct ast *
+static node_t
 parser_parse_function (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
   size_t line = parser->current.line;
 
   parser_advance_match (parser, TOKEN_LPAREN);
@@ -147,22 +153,23 @@ parser_parse_function (struct parser *parser)
 
   if (token_type_match (type, 1, TOKEN_LBRACKET))
     {
-      struct ast *program;
+      node_t program;
 
       parser_advance_match (parser, TOKEN_LBRACKET);
 
-      result = ast_create (AST_FUNCTION_DEFINITION, line);
+      result = ast_add (parser->ast, AST_FUNCTION_DEFINITION, line);
+      ast_add_payload (parser->ast, result);
       parser_append_until (parser, result, TOKEN_RBRACKET,
                            parser_parse_identifier, false);
 
       parser_advance_match (parser, TOKEN_RBRACKET);
 
       program = parser_parse_program (parser);
-      ast_append (result, program);
+      ast_append (parser->ast, result, program);
     }
   else
     {
-      result = ast_create (AST_FUNCTION_INVOCATION, line);
+      result = ast_add (parser->ast, AST_FUNCTION_INVOCATION, line);
       parser_append_until (parser, result, TOKEN_RPAREN,
                            parser_parse_expression, true);
     }
@@ -172,15 +179,15 @@ parser_parse_function (struct parser *parser)
   return result;
 }
 
-static struct ast *
+static node_t
 parser_parse_array (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
   size_t line = parser->current.line;
 
   parser_advance_match (parser, TOKEN_LBRACKET);
 
-  result = ast_create (AST_ARRAY, line);
+  result = ast_add (parser->ast, AST_ARRAY, line);
   parser_append_until (parser, result, TOKEN_RBRACKET, parser_parse_expression,
                        false);
 
@@ -189,15 +196,15 @@ parser_parse_array (struct parser *parser)
   return result;
 }
 
-static struct ast *
+static node_t
 parser_parse_structure (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
   size_t line = parser->current.line;
 
   parser_advance_match (parser, TOKEN_LBRACE);
 
-  result = ast_create (AST_STRUCTURE, line);
+  result = ast_add (parser->ast, AST_STRUCTURE, line);
   parser_append_until (parser, result, TOKEN_RBRACE, parser_parse_declaration,
                        false);
 
@@ -206,63 +213,120 @@ parser_parse_structure (struct parser *parser)
   return result;
 }
 
-static struct ast *
+// Gives `node` a payload holding the current token's text.
+static struct ast_payload *
+parser_payload (struct parser *parser, node_t node)
+{
+  struct ast_payload *payload = ast_add_payload (parser->ast, node);
+
+  payload->text = parser->current.value;
+  payload->length = parser->current.length;
+
+  return payload;
+}
+
+// Number tokens may be views into the source, so they are not terminated
+// where the literal ends; copy them out before handing them to libc.
+static void
+parser_number_text (struct parser *parser, char *text, size_t size)
+{
+  struct token *token = &parser->current;
+
+  if (token->length >= size)
+    error (token->line, "numeric literal is too long");
+
+  memcpy (text, token->value, token->length);
+  text[token->length] = '\0';
+}
+
+static node_t
 parser_parse_number (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
+  struct ast_payload *payload;
   size_t type = parser->current.type;
   size_t line = parser->current.line;
+  char text[64];
+  char *end;
+
+  parser_number_text (parser, text, sizeof (text));
+
+  type = type == TOKEN_INTEGER ? AST_INTEGER : AST_FLOAT;
+  result = ast_add (parser->ast, type, line);
+  payload = parser_payload (parser, result);
+  payload->text = intern (payload->text, payload->length);
 
-  result = ast_create (type == TOKEN_INTEGER ? AST_INTEGER : AST_FLOAT, line);
-  result->token = parser->current;
+  errno = 0;
+
+  if (type == AST_INTEGER)
+    {
+      long integer = strtol (text, &end, 10);
+
+      if (errno == ERANGE || integer > INT_MAX)
+        error (line, "integer literal `%s` is out of range", text);
+
+      payload->as.integer = integer;
+    }
+  else
+    {
+      float floating = strtof (text, &end);
+
+      if (errno == ERANGE && isinf (floating))
+        error (line, "floating-point literal `%s` is out of range", text);
+
+      payload->as.floating = floating;
+    }
+
+  if (end == text || *end != '\0')
+    error (line, "malformed number `%s`", text);
 
   parser_advance (parser);
 
   return result;
 }
 
-static struct ast *
+static node_t
 parser_parse_string (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
   size_t line = parser->current.line;
 
   parser_match (parser, TOKEN_STRING);
 
-  result = ast_create (AST_STRING, line);
-  result->token = parser->current;
+  result = ast_add (parser->ast, AST_STRING, line);
+  parser_payload (parser, result);
 
   parser_advance (parser);
 
   return result;
 }
 
-static struct ast *
+static node_t
 parser_parse_identifier (struct parser *parser)
 {
-  struct ast *identifier;
+  node_t identifier;
   size_t line = parser->current.line;
 
   parser_match (parser, TOKEN_IDENTIFIER);
 
-  identifier = ast_create (AST_IDENTIFIER, line);
-  identifier->token = parser->current;
+  identifier = ast_add (parser->ast, AST_IDENTIFIER, line);
+  parser_payload (parser, identifier);
 
   parser_advance (parser);
 
   return identifier;
 }
 
-static struct ast *
+static node_t
 parser_parse_symbol (struct parser *parser)
 {
-  struct ast *result;
+  node_t result;
   size_t line = parser->current.line;
 
   parser_match (parser, TOKEN_SYMBOL);
 
-  result = ast_create (AST_SYMBOL, line);
-  result->token = parser->current;
+  result = ast_add (parser->ast, AST_SYMBOL, line);
+  parser_payload (parser, result);
 
   parser_advance (parser);
 
@@ -286,16 +350,162 @@ parser_destroy (struct parser *parser)
   free (parser);
 }
 
+// Parses a top-level statement into `root`, noting where it came from.
+static void
+parser_parse_top_level (struct parser *parser, node_t root)
+{
+  struct ast *ast = parser->ast;
+  struct ast_statement statement;
+
+  statement.offset = parser->current.offset;
+  statement.line = parser->current.line;
+  statement.first = ast->length;
+  statement.payload = ast->data_length;
+  statement.node = parser_parse_statement (parser);
+
+  ast_append (ast, root, statement.node);
+  array_append (ast->statements, &statement);
+}
+
+// Starts a tree with its root at the current token, which is the first.
+static struct ast *
+parser_begin (struct parser *parser)
+{
+  struct ast *result = ast_create ();
+
+  result->statements = array_create (64, sizeof (struct ast_statement));
+
+  parser->ast = result;
+  parser_advance (parser);
+
+  result->root = ast_add (result, AST_PROGRAM, parser->current.line);
+
+  return result;
+}
+
+// The caller owns the tree and destroys it with `ast_destroy ()`.
 struct ast *
 parser_parse (struct parser *parser)
 {
-  parser_advance (parser);
+  struct ast *result = parser_begin (parser);
 
-  struct ast *result;
+  while (!token_type_match (parser->current.type, 2, TOKEN_RPAREN, TOKEN_EOF))
+    parser_parse_top_level (parser, result->root);
 
-  result = parser_parse_program (parser);
   parser_advance_match (parser, TOKEN_EOF);
 
+  parser->ast = NULL;
+  parser->nodes = result->length;
+
   return result;
 }
 
+// Counts the statements that start before `offset`.
+static size_t
+parser_statements_before (struct ast_statement *statements, size_t length,
+                          size_t offset)
+{
+  size_t low = 0;
+  size_t high = length;
+
+  while (low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+
+      if (statements[middle].offset < offset)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  return low;
+}
+
+// Brings `ast`, parsed from an earlier version of the source the parser's
+// buffer lexer reads, up to date with the `count` edits that turned it into
+// the current one. The result is what `parser_parse ()` would return, and
+// replaces `ast`.
+//
+// Tokens before the last statement to start ahead of the first edit cannot
+// have changed, so lexing resumes there. Statements are parsed until the
+// next token lies past every edit and sits where an old statement started;
+// from then on the old statements are reused, moved into place. A tree
+// without `statements` is parsed again from scratch.
+struct ast *
+parser_reparse (struct parser *parser, struct ast *ast,
+                const struct parser_edit *edits, size_t count)
+{
+  struct ast_statement *statements = ast->statements;
+
+  if (statements == NULL)
+    {
+      ast_destroy (ast);
+      return parser_parse (parser);
+    }
+
+  if (count == 0)
+    {
+      parser->nodes = 0;
+      return ast;
+    }
+
+  size_t length = array_length (statements);
+  size_t before = parser_statements_before (statements, length,
+                                            edits[0].offset);
+  size_t first = before > 0 ? before - 1 : 0;
+  ptrdiff_t bytes = 0;
+
+  for (size_t i = 0; i < count; ++i)
+    bytes += (ptrdiff_t)edits[i].inserted - (ptrdiff_t)edits[i].removed;
+
+  // Where the last edit ends in the current source.
+  size_t settled = edits[count - 1].offset + edits[count - 1].removed + bytes;
+
+  if (before > 0)
+    lexer_seek (parser->lexer, statements[first].offset,
+                statements[first].line);
+  else
+    lexer_seek (parser->lexer, 0, 1);
+
+  struct ast *replacement = parser_begin (parser);
+  size_t end = length;
+
+  while (end == length
+         && !token_type_match (parser->current.type, 2, TOKEN_RPAREN,
+                               TOKEN_EOF))
+    {
+      parser_parse_top_level (parser, replacement->root);
+
+      size_t offset = parser->current.offset;
+
+      if (offset >= settled)
+        {
+          end = parser_statements_before (statements, length,
+                                          offset - bytes);
+
+          if (end < length && statements[end].offset != offset - bytes)
+            end = length;
+        }
+    }
+
+  ptrdiff_t lines = 0;
+
+  if (end == length)
+    parser_advance_match (parser, TOKEN_EOF);
+  else
+    lines = (ptrdiff_t)parser->current.line - statements[end].line;
+
+  ast_splice (ast, first, end, replacement, bytes, lines);
+
+  // All but the replacement's root went into the tree.
+  parser->nodes = replacement->length - 1;
+
+  // The root is on the line of the first token, which may have moved.
+  if (before == 0)
+    ast->lines[ast->root] = replacement->lines[replacement->root];
+
+  ast_destroy (replacement);
+  parser->ast = NULL;
+
+  return ast;
+}
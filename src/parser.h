@@ -4,16 +4,30 @@
 #include "ast.h"
 #include "lexer.h"
 
+// `nodes` counts the nodes the last parse or reparse built.
 struct parser
 {
   struct lexer *lexer;
+  struct ast *ast;
   struct token current;
+  size_t nodes;
+};
+
+// Bytes `offset` up to `offset + removed` of the old source were replaced by
+// `inserted` new ones. Edits are sorted by offset and do not overlap.
+struct parser_edit
+{
+  size_t offset;
+  size_t removed;
+  size_t inserted;
 };
 
 struct parser *parser_create (struct lexer *lexer);
 void parser_destroy (struct parser *parser);
 
 struct ast *parser_parse (struct parser *parser);
+struct ast *parser_reparse (struct parser *parser, struct ast *ast,
+                            const struct parser_edit *edits, size_t count);
 
 #endif // PARSER_H
 
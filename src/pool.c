@@ -0,0 +1,117 @@
+#include "pool.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_MASK (~(uintptr_t)(POOL_SLAB_SIZE - 1))
+#define SLAB_OF(pointer) ((struct pool_slab *)((uintptr_t)(pointer) & SLAB_MASK))
+
+static void
+pool_grow (struct pool *pool, size_t class)
+{
+  struct pool_slab *slab = aligned_alloc (POOL_SLAB_SIZE, POOL_SLAB_SIZE);
+  struct pool_class *current = &pool->classes[class];
+
+  slab->next = pool->slabs;
+  slab->class = class;
+  pool->slabs = slab;
+
+  current->cursor = (char *)(slab + 1);
+  current->end = (char *)slab + POOL_SLAB_SIZE;
+  current->slabs++;
+}
+
+struct pool *
+pool_create (void)
+{
+  return calloc (1, sizeof (struct pool));
+}
+
+void
+pool_destroy (struct pool *pool)
+{
+  struct pool_slab *current = pool->slabs;
+
+  while (current != NULL)
+    {
+      struct pool_slab *previous = current;
+      current = current->next;
+
+      free (previous);
+    }
+
+  free (pool);
+}
+
+void *
+pool_allocate (struct pool *pool, size_t size)
+{
+  if (pool == NULL)
+    return calloc (1, size);
+
+  assert (size > 0 && size <= POOL_MAX_SIZE);
+
+  size_t class = (size - 1) / POOL_GRANULE;
+  size_t stride = (class + 1) * POOL_GRANULE;
+  struct pool_class *current = &pool->classes[class];
+  void *pointer;
+
+  if (current->free != NULL)
+    {
+      pointer = current->free;
+      current->free = *(void **)pointer;
+    }
+  else
+    {
+      if (current->cursor == NULL || current->cursor + stride > current->end)
+        pool_grow (pool, class);
+
+      pointer = current->cursor;
+      current->cursor += stride;
+    }
+
+  current->allocations++;
+
+  if (++current->live > current->peak)
+    current->peak = current->live;
+
+  return memset (pointer, 0, stride);
+}
+
+void
+pool_free (struct pool *pool, void *pointer)
+{
+  if (pool == NULL)
+    {
+      free (pointer);
+      return;
+    }
+
+  struct pool_class *current = &pool->classes[SLAB_OF (pointer)->class];
+
+  *(void **)pointer = current->free;
+  current->free = pointer;
+
+  current->frees++;
+  current->live--;
+}
+
+void
+pool_print_statistics (struct pool *pool, FILE *fd)
+{
+  fprintf (fd, "%-8s %12s %12s %12s %12s %8s\n", "size", "allocations",
+           "frees", "live", "peak", "slabs");
+
+  for (size_t i = 0; i < POOL_CLASSES; ++i)
+    {
+      struct pool_class *current = &pool->classes[i];
+
+      if (current->allocations == 0)
+        continue;
+
+      fprintf (fd, "%-8zu %12zu %12zu %12zu %12zu %8zu\n",
+               (i + 1) * POOL_GRANULE, current->allocations, current->frees,
+               current->live, current->peak, current->slabs);
+    }
+}
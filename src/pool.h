@@ -0,0 +1,50 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define POOL_SLAB_SIZE (16 * 1024)
+#define POOL_GRANULE 8
+#define POOL_CLASSES 8
+#define POOL_MAX_SIZE (POOL_GRANULE * POOL_CLASSES)
+
+// Slabs are aligned to their size, so the slab (and with it the size
+// class) of any object is found by masking its address.
+struct pool_slab
+{
+  struct pool_slab *next;
+  size_t class;
+};
+
+struct pool_class
+{
+  void *free;
+  char *cursor;
+  char *end;
+
+  size_t allocations;
+  size_t frees;
+  size_t live;
+  size_t peak;
+  size_t slabs;
+};
+
+// Free-list allocator for small fixed-size runtime objects, owned by one
+// interpreter and released as a whole. A NULL pool falls back to the
+// system allocator, so the same code paths work outside an interpreter.
+struct pool
+{
+  struct pool_class classes[POOL_CLASSES];
+  struct pool_slab *slabs;
+};
+
+struct pool *pool_create (void);
+void pool_destroy (struct pool *pool);
+
+void *pool_allocate (struct pool *pool, size_t size);
+void pool_free (struct pool *pool, void *pointer);
+
+void pool_print_statistics (struct pool *pool, FILE *fd);
+
+#endif // POOL_H
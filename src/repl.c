@@ -0,0 +1,191 @@
+#include "repl.h"
+#include "arena.h"
+#include "array.h"
+#include "common.h"
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+#include "resolver.h"
+#include <stdlib.h>
+
+struct repl *
+repl_create (struct vm *vm)
+{
+  struct repl *repl;
+
+  repl = calloc (1, sizeof (struct repl));
+  repl->vm = vm;
+  repl->functions = array_create (16, sizeof (struct function *));
+  repl->line = 1;
+
+  return repl;
+}
+
+void
+repl_destroy (struct repl *repl)
+{
+  for (size_t i = 0; i < array_length (repl->functions); ++i)
+    function_destroy (repl->functions[i]);
+
+  array_destroy (repl->functions);
+  free (repl);
+}
+
+// Makes a final expression statement the result, so that it gets printed.
+static void
+repl_return_last (struct ast *ast)
+{
+  size_t count = array_length (ast->statements);
+
+  if (count == 0)
+    return;
+
+  node_t last = ast->statements[count - 1].node;
+
+  if (ast->types[last] == AST_RETURN
+      || ast->types[last] == AST_VARIABLE_DECLARATION)
+    return;
+
+  node_t node = ast_add (ast, AST_RETURN, ast->lines[last]);
+
+  ast_append (ast, node, last);
+
+  if (count > 1)
+    ast->nexts[ast->statements[count - 2].node] = node;
+  else
+    ast->children[ast->root] = node;
+
+  ast->lasts[ast->root] = node;
+  ast->statements[count - 1].node = node;
+}
+
+// Runs one complete input on its own. An error unwinds back here, where
+// everything made for the input is released and the VM's frames dropped;
+// globals it already defined stay.
+static void
+repl_evaluate (struct repl *repl, char *text, size_t length)
+{
+  struct arena *arena = arena_create (ARENA_BLOCK_SIZE);
+  struct lexer *volatile lexer = NULL;
+  struct parser *volatile parser = NULL;
+  struct ast *volatile ast = NULL;
+  jmp_buf recovery;
+
+  if (setjmp (recovery) == 0)
+    {
+      error_recovery = &recovery;
+
+      lexer = lexer_create (text, length, arena, true);
+      lexer_seek (lexer, 0, repl->line);
+      parser = parser_create (lexer);
+      ast = parser_parse (parser);
+
+      if (array_length (ast->statements) > 0)
+        {
+          repl_return_last (ast);
+          resolve (ast, arena);
+
+          struct function *function = compile (ast);
+
+          array_append (repl->functions, &function);
+
+          value_t value = vm_run (repl->vm, function);
+
+          if (value != VALUE_VOID)
+            {
+              value_print (value, stdout);
+              printf ("\n");
+            }
+        }
+    }
+  else
+    {
+      compile_abandon ();
+      vm_reset (repl->vm);
+    }
+
+  error_recovery = NULL;
+
+  if (ast != NULL)
+    ast_destroy (ast);
+
+  // A tree the parser gave up on is still its own.
+  if (parser != NULL && parser->ast != NULL)
+    ast_destroy (parser->ast);
+
+  if (parser != NULL)
+    parser_destroy (parser);
+
+  if (lexer != NULL)
+    lexer_destroy (lexer);
+
+  arena_destroy (arena);
+  fflush (stdout);
+}
+
+// Reads `input` a line at a time, and runs what was read whenever its
+// brackets balance outside of strings and comments. Strings end with their
+// line, as in the lexer.
+void
+repl_run (struct repl *repl, FILE *input, bool prompt)
+{
+  char *text = array_create (256, sizeof (char));
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t length;
+  long depth = 0;
+
+  for (;;)
+    {
+      if (prompt)
+        {
+          fputs (array_length (text) > 0 ? "... " : "> ", stdout);
+          fflush (stdout);
+        }
+
+      if ((length = getline (&line, &size, input)) < 0)
+        break;
+
+      bool string = false;
+
+      for (ssize_t i = 0; i < length; ++i)
+        {
+          char c = line[i];
+
+          if (string)
+            string = c != '"';
+          else if (c == '"')
+            string = true;
+          else if (c == '-' && i + 1 < length && line[i + 1] == '-')
+            break;
+          else if (c == '(' || c == '[' || c == '{')
+            depth++;
+          else if (c == ')' || c == ']' || c == '}')
+            depth--;
+        }
+
+      for (ssize_t i = 0; i < length; ++i)
+        array_append (text, &line[i]);
+
+      if (depth > 0)
+        continue;
+
+      repl_evaluate (repl, text, array_length (text));
+
+      for (size_t i = 0; i < array_length (text); ++i)
+        repl->line += text[i] == '\n';
+
+      array_truncate (text, 0);
+      depth = 0;
+    }
+
+  // An unfinished statement at the end still gets its error.
+  if (array_length (text) > 0)
+    repl_evaluate (repl, text, array_length (text));
+
+  if (prompt)
+    printf ("\n");
+
+  free (line);
+  array_destroy (text);
+}
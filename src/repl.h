@@ -0,0 +1,22 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include "vm.h"
+#include <stdio.h>
+
+// Runs input a statement at a time in `vm`, whose globals outlive each run.
+// Compiled functions are kept until `repl_destroy ()` because globals may
+// still hold their closures and constants, so destroy the VM first.
+struct repl
+{
+  struct vm *vm;
+  struct function **functions;
+  size_t line;
+};
+
+struct repl *repl_create (struct vm *vm);
+void repl_destroy (struct repl *repl);
+
+void repl_run (struct repl *repl, FILE *input, bool prompt);
+
+#endif // REPL_H
@@ -0,0 +1,183 @@
+#include "resolver.h"
+#include "array.h"
+#include "common.h"
+#include <string.h>
+
+#define SLOT_NONE ((size_t)-1)
+
+struct resolver
+{
+  struct ast *ast;
+  struct arena *arena;
+  struct scope *scope;
+};
+
+static void resolve_node (struct resolver *resolver, node_t node);
+
+static size_t
+names_find (const char **names, size_t length, const char *name)
+{
+  for (size_t i = 0; i < length; ++i)
+    if (names[i] == name)
+      return i;
+
+  return SLOT_NONE;
+}
+
+static void
+resolver_collect (struct ast *ast, const char ***names, node_t node)
+{
+  node_t child = ast->children[node];
+
+  switch (ast->types[node])
+    {
+    case AST_FUNCTION_DEFINITION:
+      return;
+    case AST_VARIABLE_DECLARATION:
+      {
+        const char *name = ast_payload (ast, child)->text;
+
+        resolver_collect (ast, names, ast->nexts[child]);
+
+        if (names_find (*names, array_length (*names), name) == SLOT_NONE)
+          array_append (*names, &name);
+        return;
+      }
+    case AST_STRUCTURE:
+      for (node_t field = child; field != AST_NONE; field = ast->nexts[field])
+        resolver_collect (ast, names, ast->nexts[ast->children[field]]);
+      return;
+    default:
+      for (; child != AST_NONE; child = ast->nexts[child])
+        resolver_collect (ast, names, child);
+      return;
+    }
+}
+
+// Within the function being resolved only declarations that have already
+// run are visible; a nested function may run later, so it sees them all.
+static void
+resolver_lookup (struct resolver *resolver, node_t node)
+{
+  struct ast_payload *payload = ast_payload (resolver->ast, node);
+  const char *name = payload->text;
+  size_t depth = 0;
+
+  for (struct scope *scope = resolver->scope; scope;
+       scope = scope->enclosing, ++depth)
+    {
+      size_t slot = names_find (scope->names, scope->length, name);
+
+      if (slot == SLOT_NONE || (depth == 0 && !scope->defined[slot]))
+        continue;
+
+      if (depth > 0)
+        scope->captured = true;
+
+      payload->depth = depth;
+      payload->slot = slot;
+      return;
+    }
+
+  payload->depth = AST_GLOBAL;
+}
+
+static void
+resolve_declaration (struct resolver *resolver, node_t node)
+{
+  struct ast *ast = resolver->ast;
+  struct scope *scope = resolver->scope;
+  node_t identifier = ast->children[node];
+
+  resolve_node (resolver, ast->nexts[identifier]);
+
+  struct ast_payload *payload = ast_payload (ast, node);
+
+  if (scope == NULL)
+    {
+      payload->depth = AST_GLOBAL;
+      return;
+    }
+
+  payload->depth = 0;
+  payload->slot = names_find (scope->names, scope->length,
+                              ast_payload (ast, identifier)->text);
+  scope->defined[payload->slot] = true;
+}
+
+static void
+resolve_function (struct resolver *resolver, node_t node)
+{
+  struct ast *ast = resolver->ast;
+  struct scope *scope;
+  node_t current = ast->children[node];
+  const char **names = array_create (4, sizeof (const char *));
+
+  for (; ast->types[current] == AST_IDENTIFIER; current = ast->nexts[current])
+    {
+      const char *name = ast_payload (ast, current)->text;
+
+      if (names_find (names, array_length (names), name) != SLOT_NONE)
+        error (ast->lines[current], "duplicate parameter `%s`", name);
+
+      array_append (names, &name);
+    }
+
+  size_t arity = array_length (names);
+
+  resolver_collect (ast, &names, current);
+
+  scope = arena_allocate (resolver->arena, sizeof (struct scope));
+  scope->enclosing = resolver->scope;
+  scope->length = array_length (names);
+  scope->names = arena_allocate (resolver->arena,
+                                 scope->length * sizeof (const char *));
+  scope->defined = arena_allocate (resolver->arena,
+                                   scope->length * sizeof (bool));
+
+  memcpy (scope->names, names, scope->length * sizeof (const char *));
+  memset (scope->defined, true, arity * sizeof (bool));
+  array_destroy (names);
+
+  ast_payload (ast, node)->scope = scope;
+
+  resolver->scope = scope;
+  resolve_node (resolver, current);
+  resolver->scope = scope->enclosing;
+}
+
+static void
+resolve_node (struct resolver *resolver, node_t node)
+{
+  struct ast *ast = resolver->ast;
+  node_t child = ast->children[node];
+
+  switch (ast->types[node])
+    {
+    case AST_VARIABLE_DECLARATION:
+      resolve_declaration (resolver, node);
+      return;
+    case AST_FUNCTION_DEFINITION:
+      resolve_function (resolver, node);
+      return;
+    case AST_STRUCTURE:
+      for (node_t field = child; field != AST_NONE; field = ast->nexts[field])
+        resolve_node (resolver, ast->nexts[ast->children[field]]);
+      return;
+    case AST_IDENTIFIER:
+      resolver_lookup (resolver, node);
+      return;
+    default:
+      for (; child != AST_NONE; child = ast->nexts[child])
+        resolve_node (resolver, child);
+      return;
+    }
+}
+
+void
+resolve (struct ast *ast, struct arena *arena)
+{
+  struct resolver resolver = { ast, arena, NULL };
+
+  resolve_node (&resolver, ast->root);
+}
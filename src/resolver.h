@@ -0,0 +1,24 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "arena.h"
+#include "ast.h"
+#include <stdbool.h>
+
+// The variables of one function definition: its parameters, followed by
+// every name declared in its body outside nested functions and structure
+// literals. A scope is `captured` when a nested function refers to it.
+struct scope
+{
+  struct scope *enclosing;
+  const char **names;
+  bool *defined;
+  size_t length;
+  bool captured;
+};
+
+// Assigns every identifier and declaration of `ast` its (depth, slot)
+// address. Top-level names stay globals and are looked up by name.
+void resolve (struct ast *ast, struct arena *arena);
+
+#endif // RESOLVER_H
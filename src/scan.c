@@ -0,0 +1,369 @@
+#include "scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#define P (CLASS_PUNCT | CLASS_WORD)
+#define S (CLASS_PUNCT | CLASS_SPECIAL)
+
+const uint8_t SCAN_CLASSES[256] = {
+  ['\t'] = CLASS_BLANK,
+  [' '] = CLASS_BLANK,
+  ['\n'] = CLASS_NEWLINE,
+  ['\r'] = CLASS_NEWLINE,
+
+  ['!'] = P,
+  ['"'] = S,
+  ['#' ... '&'] = P,
+  ['\''] = S,
+  ['('] = S,
+  [')'] = S,
+  ['*' ... '/'] = P,
+  [':' ... '<'] = P,
+  ['='] = S,
+  ['>' ... '@'] = P,
+  ['['] = S,
+  ['\\'] = P,
+  [']'] = S,
+  ['^' ... '`'] = P,
+  ['{'] = S,
+  ['|'] = P,
+  ['}'] = S,
+  ['~'] = P,
+
+  ['0' ... '9'] = CLASS_DIGIT | CLASS_WORD,
+  ['A' ... 'Z'] = CLASS_ALPHA | CLASS_WORD,
+  ['a' ... 'z'] = CLASS_ALPHA | CLASS_WORD
+};
+
+#undef P
+#undef S
+
+static size_t
+scalar_blank (const char *s, size_t n, size_t *lines)
+{
+  size_t i = 0;
+
+  for (; i < n && SCAN_IS (s[i], CLASS_BLANK | CLASS_NEWLINE); ++i)
+    if (SCAN_IS (s[i], CLASS_NEWLINE))
+      ++*lines;
+
+  return i;
+}
+
+static size_t
+scalar_line (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  while (i < n && !SCAN_IS (s[i], CLASS_NEWLINE) && s[i] != '\0')
+    i++;
+
+  return i;
+}
+
+static size_t
+scalar_string (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  while (i < n && !SCAN_IS (s[i], CLASS_NEWLINE) && s[i] != '\0'
+         && s[i] != '"')
+    i++;
+
+  return i;
+}
+
+static size_t
+scalar_word (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  while (i < n && SCAN_IS (s[i], CLASS_WORD))
+    i++;
+
+  return i;
+}
+
+static const struct scanner SCALAR = {
+  "scalar", scalar_blank, scalar_line, scalar_string, scalar_word
+};
+
+#ifdef SCAN_X86
+
+// The vector scanners classify 16 or 32 bytes at once into a bit mask of
+// bytes that end the run, and fall back to the scalar scanners for the
+// tail. Bytes >= 0x80 compare as negative, which keeps them out of words.
+
+static size_t
+sse2_blank (const char *s, size_t n, size_t *lines)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i x = _mm_loadu_si128 ((const __m128i *)&s[i]);
+      __m128i newline = _mm_or_si128 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\n')),
+                                      _mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\r')));
+      __m128i blank = _mm_or_si128 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 (' ')),
+                                    _mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\t')));
+
+      unsigned stop = ~_mm_movemask_epi8 (_mm_or_si128 (newline, blank));
+      unsigned newlines = _mm_movemask_epi8 (newline);
+
+      if ((stop &= 0xffff) != 0)
+        {
+          unsigned length = __builtin_ctz (stop);
+
+          *lines += __builtin_popcount (newlines & ((1u << length) - 1));
+          return i + length;
+        }
+
+      *lines += __builtin_popcount (newlines);
+    }
+
+  return i + scalar_blank (&s[i], n - i, lines);
+}
+
+static unsigned
+sse2_line_stops (__m128i x)
+{
+  __m128i stop = _mm_or_si128 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\n')),
+                               _mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\r')));
+
+  stop = _mm_or_si128 (stop, _mm_cmpeq_epi8 (x, _mm_setzero_si128 ()));
+
+  return _mm_movemask_epi8 (stop);
+}
+
+static size_t
+sse2_line (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16)
+    {
+      unsigned stop = sse2_line_stops (_mm_loadu_si128 ((const __m128i *)&s[i]));
+
+      if (stop != 0)
+        return i + __builtin_ctz (stop);
+    }
+
+  return i + scalar_line (&s[i], n - i);
+}
+
+static size_t
+sse2_string (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i x = _mm_loadu_si128 ((const __m128i *)&s[i]);
+      unsigned stop = sse2_line_stops (x);
+
+      stop |= _mm_movemask_epi8 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 ('"')));
+
+      if (stop != 0)
+        return i + __builtin_ctz (stop);
+    }
+
+  return i + scalar_string (&s[i], n - i);
+}
+
+static size_t
+sse2_word (const char *s, size_t n)
+{
+  static const char SPECIAL[] = "'\"=()[]{}";
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i x = _mm_loadu_si128 ((const __m128i *)&s[i]);
+      __m128i word = _mm_and_si128 (_mm_cmpgt_epi8 (x, _mm_set1_epi8 (0x20)),
+                                    _mm_cmplt_epi8 (x, _mm_set1_epi8(0x7f)));
+
+      for (const char *c = SPECIAL; *c != '\0'; ++c)
+        word = _mm_andnot_si128 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 (*c)),
+                                 word);
+
+      unsigned stop = ~_mm_movemask_epi8 (word) & 0xffff;
+
+      if (stop != 0)
+        return i + __builtin_ctz (stop);
+    }
+
+  return i + scalar_word (&s[i], n - i);
+}
+
+static const struct scanner SSE2 = {
+  "sse2", sse2_blank, sse2_line, sse2_string, sse2_word
+};
+
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+
+TARGET_AVX2 static size_t
+avx2_blank (const char *s, size_t n, size_t *lines)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i x = _mm256_loadu_si256 ((const __m256i *)&s[i]);
+      __m256i newline
+          = _mm256_or_si256 (_mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('\n')),
+                             _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('\r')));
+      __m256i blank
+          = _mm256_or_si256 (_mm256_cmpeq_epi8 (x, _mm256_set1_epi8 (' ')),
+                             _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('\t')));
+
+      uint32_t stop = ~(uint32_t)_mm256_movemask_epi8 (
+          _mm256_or_si256 (newline, blank));
+      uint32_t newlines = _mm256_movemask_epi8 (newline);
+
+      if (stop != 0)
+        {
+          unsigned length = __builtin_ctz (stop);
+
+          *lines += __builtin_popcount (newlines
+                                        & (uint32_t)((1ull << length) - 1));
+          return i + length;
+        }
+
+      *lines += __builtin_popcount (newlines);
+    }
+
+  return i + sse2_blank (&s[i], n - i, lines);
+}
+
+TARGET_AVX2 static uint32_t
+avx2_line_stops (__m256i x)
+{
+  __m256i stop
+      = _mm256_or_si256 (_mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('\n')),
+                         _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('\r')));
+
+  stop = _mm256_or_si256 (stop,
+                          _mm256_cmpeq_epi8 (x, _mm256_setzero_si256 ()));
+
+  return _mm256_movemask_epi8 (stop);
+}
+
+TARGET_AVX2 static size_t
+avx2_line (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i x = _mm256_loadu_si256 ((const __m256i *)&s[i]);
+      uint32_t stop = avx2_line_stops (x);
+
+      if (stop != 0)
+        return i + __builtin_ctz (stop);
+    }
+
+  return i + sse2_line (&s[i], n - i);
+}
+
+TARGET_AVX2 static size_t
+avx2_string (const char *s, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i x = _mm256_loadu_si256 ((const __m256i *)&s[i]);
+      uint32_t stop = avx2_line_stops (x);
+
+      stop |= _mm256_movemask_epi8 (
+          _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('"')));
+
+      if (stop != 0)
+        return i + __builtin_ctz (stop);
+    }
+
+  return i + sse2_string (&s[i], n - i);
+}
+
+TARGET_AVX2 static size_t
+avx2_word (const char *s, size_t n)
+{
+  static const char SPECIAL[] = "'\"=()[]{}";
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i x = _mm256_loadu_si256 ((const __m256i *)&s[i]);
+      __m256i word
+          = _mm256_and_si256 (_mm256_cmpgt_epi8 (x, _mm256_set1_epi8 (0x20)),
+                              _mm256_cmpgt_epi8 (_mm256_set1_epi8 (0x7f), x));
+
+      for (const char *c = SPECIAL; *c != '\0'; ++c)
+        word = _mm256_andnot_si256 (
+            _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 (*c)), word);
+
+      uint32_t stop = ~(uint32_t)_mm256_movemask_epi8 (word);
+
+      if (stop != 0)
+        return i + __builtin_ctz (stop);
+    }
+
+  return i + sse2_word (&s[i], n - i);
+}
+
+static const struct scanner AVX2 = {
+  "avx2", avx2_blank, avx2_line, avx2_string, avx2_word
+};
+
+#endif
+
+static const struct scanner *available[4];
+static const struct scanner *current;
+
+const struct scanner *const *
+scanner_available (void)
+{
+  if (available[0] != NULL)
+    return available;
+
+  size_t count = 0;
+
+#ifdef SCAN_X86
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+    available[count++] = &AVX2;
+
+  available[count++] = &SSE2;
+#endif
+
+  available[count++] = &SCALAR;
+
+  return available;
+}
+
+const struct scanner *
+scanner_get (void)
+{
+  if (current == NULL)
+    current = scanner_available ()[0];
+
+  return current;
+}
+
+bool
+scanner_select (const char *name)
+{
+  for (const struct scanner *const *s = scanner_available (); *s; ++s)
+    if (strcmp ((*s)->name, name) == 0)
+      {
+        current = *s;
+        return true;
+      }
+
+  return false;
+}
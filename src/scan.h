@@ -0,0 +1,45 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum
+{
+  CLASS_NEWLINE = 1 << 0,
+  CLASS_BLANK = 1 << 1,
+  CLASS_DIGIT = 1 << 2,
+  CLASS_ALPHA = 1 << 3,
+  CLASS_PUNCT = 1 << 4,
+  CLASS_SPECIAL = 1 << 5,
+  CLASS_WORD = 1 << 6
+};
+
+// Locale-independent character classes for the lexer. CLASS_WORD marks the
+// characters that may continue an identifier: any graphic character that is
+// not one of the special characters `'"=()[]{}`.
+extern const uint8_t SCAN_CLASSES[256];
+
+#define SCAN_IS(ch, classes) (SCAN_CLASSES[(uint8_t)(ch)] & (classes))
+
+// Each scanner returns the length of the longest prefix of `s[0 .. n)`
+// that belongs to its run. `blank` also adds the newlines it skipped
+// to `*lines`.
+struct scanner
+{
+  const char *name;
+  size_t (*blank) (const char *s, size_t n, size_t *lines);
+  size_t (*line) (const char *s, size_t n);
+  size_t (*string) (const char *s, size_t n);
+  size_t (*word) (const char *s, size_t n);
+};
+
+// `scanner_get ()` returns the fastest scanner this CPU supports, unless
+// another one was chosen with `scanner_select ()`. `scanner_available ()`
+// lists the supported scanners, terminated by NULL.
+const struct scanner *scanner_get (void);
+bool scanner_select (const char *name);
+const struct scanner *const *scanner_available (void);
+
+#endif // SCAN_H
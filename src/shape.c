@@ -0,0 +1,133 @@
+#include "shape.h"
+#include "array.h"
+#include <stdlib.h>
+
+// Every shape created, the root first.
+static struct shape **shapes;
+
+static struct shape *
+shape_create (struct shape *parent, const char *name)
+{
+  struct shape *shape = calloc (1, sizeof (struct shape));
+
+  shape->parent = parent;
+  shape->name = name;
+  shape->length = parent != NULL ? parent->length + 1 : 0;
+  shape->transitions = array_create (1, sizeof (struct shape *));
+
+  array_append (shapes, &shape);
+
+  return shape;
+}
+
+struct shape *
+shape_root (void)
+{
+  if (shapes == NULL)
+    {
+      shapes = array_create (64, sizeof (struct shape *));
+      shape_create (NULL, NULL);
+    }
+
+  return shapes[0];
+}
+
+struct shape *
+shape_add (struct shape *shape, const char *name)
+{
+  for (size_t i = 0; i < array_length (shape->transitions); ++i)
+    if (shape->transitions[i]->name == name)
+      return shape->transitions[i];
+
+  struct shape *child = shape_create (shape, name);
+
+  array_append (shape->transitions, &child);
+
+  return child;
+}
+
+// A field added twice (as in `{ a = 1 a = 2 }`) resolves to its last slot.
+size_t
+shape_find (struct shape *shape, const char *name)
+{
+  if (shape->length <= SHAPE_LINEAR)
+    {
+      for (struct shape *current = shape; current->parent != NULL;
+           current = current->parent)
+        if (current->name == name)
+          return current->length - 1;
+
+      return SHAPE_NONE;
+    }
+
+  if (shape->fields == NULL)
+    {
+      shape->fields = hash_table_create (NULL, shape->length * 2);
+
+      for (struct shape *current = shape; current->parent != NULL;
+           current = current->parent)
+        if (hash_table_find (shape->fields, current->name) == VALUE_NONE)
+          hash_table_append (shape->fields, current->name,
+                             value_integer (current->length - 1));
+    }
+
+  value_t slot = hash_table_find (shape->fields, name);
+
+  return slot != VALUE_NONE ? (size_t)value_as_integer (slot) : SHAPE_NONE;
+}
+
+size_t
+shape_count (void)
+{
+  return shapes != NULL ? array_length (shapes) : 0;
+}
+
+void
+shape_destroy_all (void)
+{
+  if (shapes == NULL)
+    return;
+
+  for (size_t i = 0; i < array_length (shapes); ++i)
+    {
+      if (shapes[i]->fields != NULL)
+        hash_table_destroy (shapes[i]->fields);
+
+      array_destroy (shapes[i]->transitions);
+      free (shapes[i]);
+    }
+
+  array_destroy (shapes);
+  shapes = NULL;
+}
+
+size_t
+structure_size (size_t length)
+{
+  return sizeof (struct structure) + length * sizeof (value_t);
+}
+
+struct structure *
+structure_create (struct pool *pool, struct shape *shape)
+{
+  struct structure *structure;
+  size_t size = structure_size (shape->length);
+
+  if (size <= POOL_MAX_SIZE)
+    structure = pool_allocate (pool, size);
+  else
+    structure = calloc (1, size);
+
+  structure->shape = shape;
+
+  return structure;
+}
+
+void
+structure_destroy (struct pool *pool, struct structure *structure)
+{
+  if (structure_size (structure->shape->length) <= POOL_MAX_SIZE)
+    pool_free (pool, structure);
+  else
+    free (structure);
+}
@@ -0,0 +1,45 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include "pool.h"
+#include "tables.h"
+#include "value.h"
+
+#define SHAPE_NONE ((size_t)-1)
+#define SHAPE_LINEAR 8
+
+// The layout shared by all structures with the same fields in the same
+// order: field `name` is in slot `length - 1`, the fields before it are the
+// `parent` shape's. Shapes form a tree from the empty root, with one
+// transition per field added, and live until `shape_destroy_all ()`.
+//
+// Shapes with more than SHAPE_LINEAR fields build the `fields` table (name
+// to slot) on their first lookup; smaller ones search the parent chain.
+struct shape
+{
+  struct shape *parent;
+  const char *name;
+  size_t length;
+  struct shape **transitions;
+  struct hash_table *fields;
+};
+
+// A structure is its shape and one slot per field.
+struct structure
+{
+  struct shape *shape;
+  value_t slots[];
+};
+
+struct shape *shape_root (void);
+struct shape *shape_add (struct shape *shape, const char *name);
+size_t shape_find (struct shape *shape, const char *name);
+size_t shape_count (void);
+void shape_destroy_all (void);
+
+size_t structure_size (size_t length);
+
+struct structure *structure_create (struct pool *pool, struct shape *shape);
+void structure_destroy (struct pool *pool, struct structure *structure);
+
+#endif // SHAPE_H
@@ -0,0 +1,61 @@
+#include "source.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct source *
+source_open (const char *path)
+{
+  struct source *source;
+  struct stat status;
+  int fd;
+
+  if ((fd = open (path, O_RDONLY)) < 0)
+    {
+      perror (path);
+      return NULL;
+    }
+
+  if (fstat (fd, &status) < 0)
+    {
+      perror (path);
+      close (fd);
+      return NULL;
+    }
+
+  source = calloc (1, sizeof (struct source));
+  source->length = status.st_size;
+
+  // `mmap ()` rejects empty mappings; an empty script needs no buffer.
+  if (source->length > 0)
+    {
+      source->buffer = mmap (NULL, source->length, PROT_READ, MAP_PRIVATE,
+                             fd, 0);
+
+      if (source->buffer == MAP_FAILED)
+        {
+          perror (path);
+          free (source);
+          close (fd);
+          return NULL;
+        }
+
+      madvise (source->buffer, source->length, MADV_SEQUENTIAL);
+    }
+
+  close (fd);
+
+  return source;
+}
+
+void
+source_close (struct source *source)
+{
+  if (source->buffer != NULL)
+    munmap (source->buffer, source->length);
+
+  free (source);
+}
@@ -0,0 +1,17 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// A script loaded into memory. Regular files are mapped read-only, so
+// `buffer` is not NUL-terminated and must be read through `length`.
+struct source
+{
+  char *buffer;
+  size_t length;
+};
+
+struct source *source_open (const char *path);
+void source_close (struct source *source);
+
+#endif // SOURCE_H
@@ -1,75 +1,170 @@
 #include "tables.h"
-#include "common.h"
 #include <stdlib.h>
-#include <string.h>
+
+#define HASH_NONE ((size_t)-1)
+
+static struct hash_table_statistics statistics;
 
 static size_t
-hash (const char *key, size_t capacity)
+hash (const char *key)
 {
-  size_t hash = 5381;
-  char c;
+  uint64_t hash = (uintptr_t)key;
 
-  while ((c = *key++))
-    hash = ((hash << 5) + hash) + c;
+  hash *= 0x9e3779b97f4a7c15;
 
-  return hash % capacity;
+  return hash ^ hash >> 32;
 }
 
-static struct bucket *
-bucket_create (const char *key, struct value *value)
+// Slots of `entries` below `moved` have already been migrated, so an empty
+// one there does not end the probe.
+static size_t
+hash_table_probe (struct hash_entry *entries, size_t capacity,
+                  size_t longest, size_t moved, const char *key, size_t hash)
 {
-  struct bucket *bucket;
+  size_t mask = capacity - 1;
+
+  for (size_t d = 0, i = hash & mask; d <= longest; ++d, i = (i + 1) & mask)
+    {
+      struct hash_entry *entry = &entries[i];
 
-  bucket = calloc (1, sizeof (struct bucket));
-  bucket->key = xstrdup (key);
-  bucket->value = value;
+      if (entry->key == NULL)
+        {
+          if (i >= moved)
+            break;
+          continue;
+        }
+
+      if (entry->hash == hash && entry->key == key)
+        return i;
+
+      if (((i - entry->hash) & mask) < d)
+        break;
+    }
 
-  return bucket;
+  return HASH_NONE;
 }
 
 static void
-bucket_destroy (struct bucket *bucket)
+hash_table_place (struct hash_table *table, struct hash_entry entry)
 {
-  free (bucket->key);
-  free (bucket);
+  size_t mask = table->capacity - 1;
+
+  for (size_t d = 0, i = entry.hash & mask;; ++d, i = (i + 1) & mask)
+    {
+      struct hash_entry *slot = &table->entries[i];
+      size_t resident = (i - slot->hash) & mask;
+
+      if (slot->key != NULL && resident >= d)
+        continue;
+
+      if (d > table->distance)
+        table->distance = d;
+
+      if (slot->key == NULL)
+        {
+          *slot = entry;
+          return;
+        }
+
+      struct hash_entry displaced = *slot;
+
+      *slot = entry;
+      entry = displaced;
+      d = resident;
+    }
 }
 
 static void
-hash_table_resize (struct hash_table *table)
+hash_table_shift (struct hash_entry *entries, size_t capacity, size_t i)
 {
-  struct bucket **old_buckets = table->buckets;
-  size_t old_capacity = table->capacity;
+  size_t mask = capacity - 1;
 
-  table->capacity = table->capacity * 2;
-  table->buckets = calloc (table->capacity, sizeof (struct bucket *));
-  table->length = 0;
+  for (size_t j = (i + 1) & mask;; i = j, j = (j + 1) & mask)
+    {
+      if (entries[j].key == NULL || ((j - entries[j].hash) & mask) == 0)
+        {
+          entries[i] = (struct hash_entry){ 0 };
+          return;
+        }
+
+      entries[i] = entries[j];
+    }
+}
+
+static void
+hash_table_migrate (struct hash_table *table, size_t steps)
+{
+  if (table->old == NULL)
+    return;
 
-  for (size_t i = 0; i < old_capacity; ++i)
+  for (; steps > 0 && table->cursor < table->old_capacity; --steps)
     {
-      struct bucket *current = old_buckets[i];
+      struct hash_entry *entry = &table->old[table->cursor++];
 
-      while (current != NULL)
-        {
-          hash_table_append (table, current->key, current->value);
+      if (entry->key != NULL)
+        hash_table_place (table, *entry);
 
-          struct bucket *previous = current;
-          current = current->next;
+      *entry = (struct hash_entry){ 0 };
+    }
 
-          bucket_destroy (previous);
-        }
+  if (table->cursor == table->old_capacity)
+    {
+      free (table->old);
+      table->old = NULL;
     }
+}
+
+static void
+hash_table_grow (struct hash_table *table)
+{
+  hash_table_migrate (table, SIZE_MAX);
+
+  table->old = table->entries;
+  table->old_capacity = table->capacity;
+  table->old_distance = table->distance;
+  table->cursor = 0;
+
+  table->capacity = table->capacity * 2;
+  table->entries = calloc (table->capacity, sizeof (struct hash_entry));
+
+  statistics.slots += table->capacity;
+  table->distance = 0;
+}
+
+static struct hash_entry *
+hash_table_lookup (struct hash_table *table, const char *key, size_t hash)
+{
+  size_t i = hash_table_probe (table->entries, table->capacity,
+                               table->distance, 0, key, hash);
 
-  free (old_buckets);
+  if (i != HASH_NONE)
+    return &table->entries[i];
+
+  if (table->old == NULL)
+    return NULL;
+
+  i = hash_table_probe (table->old, table->old_capacity, table->old_distance,
+                        table->cursor, key, hash);
+
+  return i != HASH_NONE ? &table->old[i] : NULL;
 }
 
 struct hash_table *
-hash_table_create (size_t capacity)
+hash_table_create (struct pool *pool, size_t capacity)
 {
   struct hash_table *table;
 
-  table = calloc (1, sizeof (struct hash_table));
-  table->buckets = calloc (capacity, sizeof (struct bucket *));
-  table->capacity = capacity;
+  table = pool_allocate (pool, sizeof (struct hash_table));
+  table->pool = pool;
+  table->capacity = 4;
+
+  while (table->capacity < capacity)
+    table->capacity *= 2;
+
+  table->entries = calloc (table->capacity, sizeof (struct hash_entry));
+
+  statistics.tables++;
+  statistics.slots += table->capacity;
 
   return table;
 }
@@ -77,64 +172,97 @@ hash_table_create (size_t capacity)
 void
 hash_table_destroy (struct hash_table *table)
 {
-  for (size_t i = 0; i < table->capacity; ++i)
-    {
-      struct bucket *current = table->buckets[i];
-
-      while (current != NULL)
-        {
-          struct bucket *previous = current;
-          current = current->next;
-
-          bucket_destroy (previous);
-        }
-    }
-
-  free (table->buckets);
-  free (table);
+  free (table->entries);
+  free (table->old);
+  pool_free (table->pool, table);
 }
 
 void
 hash_table_append (struct hash_table *table, const char *key,
-                   struct value *value)
+                   value_t value)
 {
-  size_t index = hash (key, table->capacity);
-  struct bucket *current = table->buckets[index];
-
-  while (current != NULL)
-    if (strcmp (current->key, key) != 0)
-      current = current->next;
-    else
-      {
-        current->value = value;
-        return;
-      }
- 
-  struct bucket *new = bucket_create (key, value);
-
-  new->next = table->buckets[index];
-  table->buckets[index] = new;
+  size_t h = hash (key);
+
+  hash_table_migrate (table, HASH_TABLE_MIGRATE);
+
+  struct hash_entry *entry = hash_table_lookup (table, key, h);
 
+  if (entry != NULL)
+    {
+      entry->value = value;
+      return;
+    }
+
+  if ((table->length + 1) * 4 > (size_t)table->capacity * 3)
+    hash_table_grow (table);
+
+  hash_table_place (table, (struct hash_entry){ key, value, h });
   table->length++;
 
-  if ((float)table->length / table->capacity > 0.75)
-    hash_table_resize (table);
+  statistics.insertions++;
 }
 
-struct value *
+value_t
 hash_table_find (struct hash_table *table, const char *key)
 {
-  size_t index = hash (key, table->capacity);
-  struct bucket *current = table->buckets[index];
+  struct hash_entry *entry = hash_table_lookup (table, key, hash (key));
+
+  return entry != NULL ? entry->value : VALUE_NONE;
+}
+
+bool
+hash_table_remove (struct hash_table *table, const char *key)
+{
+  size_t h = hash (key);
+
+  hash_table_migrate (table, HASH_TABLE_MIGRATE);
+
+  size_t i = hash_table_probe (table->entries, table->capacity,
+                               table->distance, 0, key, h);
+
+  if (i != HASH_NONE)
+    hash_table_shift (table->entries, table->capacity, i);
+  else if (table->old != NULL
+           && (i = hash_table_probe (table->old, table->old_capacity,
+                                     table->old_distance, table->cursor, key,
+                                     h))
+                  != HASH_NONE)
+    hash_table_shift (table->old, table->old_capacity, i);
+  else
+    return false;
+
+  table->length--;
+
+  return true;
+}
+
+bool
+hash_table_next (struct hash_table *table, size_t *iterator,
+                 const char **key, value_t *value)
+{
+  size_t old_capacity = table->old != NULL ? table->old_capacity : 0;
 
-  while (current != NULL)
+  for (; *iterator < table->capacity + old_capacity; ++*iterator)
     {
-      if (strcmp (current->key, key) == 0)
-        return current->value;
+      struct hash_entry *entry = *iterator < table->capacity
+                                     ? &table->entries[*iterator]
+                                     : &table->old[*iterator
+                                                   - table->capacity];
 
-      current = current->next;
+      if (entry->key != NULL)
+        {
+          *key = entry->key;
+          *value = entry->value;
+          ++*iterator;
+          return true;
+        }
     }
 
-  return NULL;
+  return false;
 }
 
+const struct hash_table_statistics *
+hash_table_statistics (void)
+{
+  return &statistics;
+}
@@ -1,28 +1,65 @@
 #ifndef TABLES_H
 #define TABLES_H
 
+#include "pool.h"
 #include "value.h"
+#include <stdbool.h>
+#include <stdint.h>
 
-struct bucket
+#define HASH_TABLE_MIGRATE 16
+
+// Keys are borrowed: usually interned strings (see intern.h), but any
+// pointer that outlives the table will do. The table neither copies nor
+// frees them and compares them by address. An empty entry has a NULL key.
+struct hash_entry
 {
-  struct bucket *next;
-  char *key;
-  struct value *value;
+  const char *key;
+  value_t value;
+  size_t hash;
 };
 
+// A Robin Hood table: `entries` is probed linearly from `hash & (capacity
+// - 1)` and kept ordered by probe distance, so lookups stop early and
+// deletions shift the following entries back instead of leaving tombstones.
+//
+// Growing allocates the larger array at once but moves the `old` entries
+// over HASH_TABLE_MIGRATE slots per insert or remove; `cursor` is the next
+// old slot to move. Until it is done, lookups check both arrays.
 struct hash_table
 {
-  struct bucket **buckets;
+  struct pool *pool;
+  struct hash_entry *entries;
+  struct hash_entry *old;
   size_t length;
-  size_t capacity;
+  uint32_t capacity;
+  uint32_t distance;
+  uint32_t old_capacity;
+  uint32_t old_distance;
+  uint32_t cursor;
+};
+
+// Process-wide counts, for `--stats`: tables created, entry slots allocated
+// and keys inserted.
+struct hash_table_statistics
+{
+  size_t tables;
+  size_t slots;
+  size_t insertions;
 };
 
-struct hash_table *hash_table_create (size_t capacity);
+struct hash_table *hash_table_create (struct pool *pool, size_t capacity);
 void hash_table_destroy (struct hash_table *table);
 
 void hash_table_append (struct hash_table *table, const char *key,
-                        struct value *value);
-struct value *hash_table_find (struct hash_table *table, const char *key);
+                        value_t value);
+value_t hash_table_find (struct hash_table *table, const char *key);
+bool hash_table_remove (struct hash_table *table, const char *key);
 
-#endif // TABLES_H
+// Visits every entry once; `*iterator` starts at 0. The table must not be
+// modified while it is being iterated.
+bool hash_table_next (struct hash_table *table, size_t *iterator,
+                      const char **key, value_t *value);
+
+const struct hash_table_statistics *hash_table_statistics (void);
 
+#endif // TABLES_H
@@ -1,6 +1,5 @@
 #include "token.h"
 #include <stdarg.h>
-#include <stdlib.h>
 
 static const char *const TYPES[] = {
   "INTEGER",
@@ -20,24 +19,20 @@ static const char *const TYPES[] = {
 };
 
 struct token
-token_create (char *value, size_t type, size_t line)
+token_create (const char *value, size_t length, size_t type, size_t line,
+              size_t offset)
 {
   struct token token;
 
   token.value = value;
+  token.length = length;
   token.type = type;
   token.line = line;
+  token.offset = offset;
 
   return token;
 }
 
-void
-token_destroy (struct token token)
-{
-  free (token.value);
-  token.value = NULL;
-}
-
 bool
 token_type_match (size_t type, size_t n, ...)
 {
@@ -26,15 +26,21 @@ enum
   TOKEN_EOF
 };
 
+// Identifier and symbol values are interned. Other values are either a
+// view into the lexer's source buffer or an arena copy and are only
+// NUL-terminated in the latter case, so always honour `length`. `offset` is
+// the byte where the token starts in the whole input.
 struct token
 {
-  char *value;
+  const char *value;
+  size_t length;
   size_t type;
   size_t line;
+  size_t offset;
 };
 
-struct token token_create (char *value, size_t type, size_t line);
-void token_destroy (struct token token);
+struct token token_create (const char *value, size_t length, size_t type,
+                           size_t line, size_t offset);
 
 bool token_type_match (size_t type, size_t n, ...);
 const char *token_type_string (size_t type);
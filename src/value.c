@@ -1,4 +1,6 @@
 #include "value.h"
+#include "shape.h"
+#include "vector.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,69 +17,122 @@ static const char *const TYPES[] = {
   "VOID"
 };
 
+// Heap values created so far, for `--stats`.
+static size_t created;
+
 struct value *
-value_create (size_t type)
+value_create (struct pool *pool, size_t type)
 {
   struct value *value;
 
-  value = calloc (1, sizeof (struct value));
+  created++;
+
+  value = pool_allocate (pool, sizeof (struct value));
   value->type = type;
 
   return value;
 }
 
+size_t
+value_count (void)
+{
+  return created;
+}
+
 void
-value_destroy (struct value *value)
+value_destroy (struct pool *pool, value_t value)
 {
-  switch (value->type)
+  if (!VALUE_IS_OBJECT (value))
+    return;
+
+  struct value *object = value_as_object (value);
+
+  switch (object->type)
     {
-    case TYPE_INTEGER:
-    case TYPE_FLOAT:
-      break;
     case TYPE_STRING:
-    case TYPE_SYMBOL:
-      free (value->p);
       break;
     case TYPE_ARRAY:
+      vector_destroy (pool, object->p);
       break;
     case TYPE_STRUCTURE:
+      structure_destroy (pool, object->p);
       break;
 
     case TYPE_FUNTION:
+      pool_free (pool, object->p);
       break;
     case TYPE_NATIVE:
       break;
+    }
 
-    case TYPE_VOID:
+  pool_free (pool, object);
+}
+
+// An estimate of the memory `value` holds, for collection thresholds. The
+// nodes of arrays are shared, so the collector counts those separately.
+size_t
+value_size (struct value *value)
+{
+  size_t size = sizeof (struct value);
+
+  switch (value->type)
+    {
+    case TYPE_ARRAY:
+      size += sizeof (struct vector);
+      break;
+    case TYPE_STRUCTURE:
+      {
+        struct structure *structure = value->p;
+
+        size += structure_size (structure->shape->length);
+        break;
+      }
+    case TYPE_FUNTION:
+      size += 2 * sizeof (void *);
       break;
     }
 
-  free (value);
+  return size;
 }
 
 void
-value_print (struct value *value, FILE *fd)
+value_print (value_t value, FILE *fd)
 {
-  switch (value->type)
+  size_t type = value_type (value);
+
+  switch (type)
     {
     case TYPE_INTEGER:
-      fprintf (fd, "%i", value->i);
+      fprintf (fd, "%i", value_as_integer (value));
       break;
     case TYPE_FLOAT:
-      fprintf (fd, "%g", value->f);
+      fprintf (fd, "%g", value_as_float (value));
       break;
     case TYPE_STRING:
-      fprintf (fd, "\"%s\"", (char *)value->p);
+      fprintf (fd, "\"%s\"", (char *)value_as_object (value)->p);
       break;
     case TYPE_SYMBOL:
-      fprintf (fd, "'%s", (char *)value->p);
+      fprintf (fd, "'%s", value_as_symbol (value));
       break;
     case TYPE_ARRAY:
+      {
+        struct vector *vector = value_as_object (value)->p;
+
+        fprintf (fd, "[");
+        for (size_t i = 0; i < vector->length; ++i)
+          {
+            if (i > 0)
+              fprintf (fd, " ");
+            value_print (vector_get (vector, i), fd);
+          }
+        fprintf (fd, "]");
+        break;
+      }
     case TYPE_STRUCTURE:
     case TYPE_FUNTION:
     case TYPE_NATIVE:
     case TYPE_VOID:
-      fprintf (fd, "(%s)", value_type_string (value->type));
+      fprintf (fd, "(%s)", value_type_string (type));
       break;
     }
 }
@@ -1,9 +1,12 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include "pool.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 enum
 {
@@ -22,25 +25,128 @@ enum
   TYPE_VOID
 };
 
+// A `value_t` is one machine word. The low TAG_BITS select its kind:
+// integers and floats are stored in the upper 32 bits, symbols are tagged
+// pointers to interned text, void is a bare tag, and TAG_OBJECT words are
+// pointers to a heap-allocated `struct value`.
+typedef uint64_t value_t;
+
+enum
+{
+  TAG_OBJECT,
+  TAG_INTEGER,
+  TAG_FLOAT,
+  TAG_SYMBOL,
+  TAG_VOID
+};
+
+#define TAG_BITS 3
+#define TAG_MASK ((value_t)((1 << TAG_BITS) - 1))
+
+#define VALUE_TAG(value) ((value) & TAG_MASK)
+#define VALUE_IS_OBJECT(value) (VALUE_TAG (value) == TAG_OBJECT)
+
+// `VALUE_NONE` is never a valid value; lookups use it to mean "absent".
+#define VALUE_NONE ((value_t)0)
+#define VALUE_VOID ((value_t)TAG_VOID)
+
+// Heap cell for the types that cannot be immediate: strings, arrays,
+// structures, functions and natives. Strings point to interned text, which
+// they share and never free. `marked` belongs to the collector (see gc.h),
+// which leaves `constant` values alone: they belong to a compiled function,
+// may be shared between VMs and only ever hold other constants.
 struct value
 {
   size_t type;
-  size_t refs;
-  union
-  {
-    int i;
-    float f;
-    void *p;
-  };
+  bool marked;
+  bool constant;
+  void *p;
 };
 
-struct value *value_create (size_t type);
-void value_destroy (struct value *value);
+static inline value_t
+value_integer (int i)
+{
+  return (value_t)(uint32_t)i << 32 | TAG_INTEGER;
+}
+
+static inline int
+value_as_integer (value_t value)
+{
+  return (int32_t)(value >> 32);
+}
+
+static inline value_t
+value_float (float f)
+{
+  uint32_t bits;
+
+  memcpy (&bits, &f, sizeof (bits));
 
-void value_print (struct value *value, FILE *fd);
+  return (value_t)bits << 32 | TAG_FLOAT;
+}
+
+static inline float
+value_as_float (value_t value)
+{
+  uint32_t bits = value >> 32;
+  float f;
+
+  memcpy (&f, &bits, sizeof (f));
+
+  return f;
+}
+
+// Interned text is arena-allocated and therefore aligned well past TAG_BITS.
+static inline value_t
+value_symbol (const char *symbol)
+{
+  return (uintptr_t)symbol | TAG_SYMBOL;
+}
+
+static inline const char *
+value_as_symbol (value_t value)
+{
+  return (const char *)(uintptr_t)(value & ~TAG_MASK);
+}
+
+static inline value_t
+value_object (struct value *object)
+{
+  return (uintptr_t)object;
+}
+
+static inline struct value *
+value_as_object (value_t value)
+{
+  return (struct value *)(uintptr_t)value;
+}
+
+static inline size_t
+value_type (value_t value)
+{
+  switch (VALUE_TAG (value))
+    {
+    case TAG_INTEGER:
+      return TYPE_INTEGER;
+    case TAG_FLOAT:
+      return TYPE_FLOAT;
+    case TAG_SYMBOL:
+      return TYPE_SYMBOL;
+    case TAG_VOID:
+      return TYPE_VOID;
+    default:
+      return value_as_object (value)->type;
+    }
+}
+
+struct value *value_create (struct pool *pool, size_t type);
+size_t value_count (void);
+void value_destroy (struct pool *pool, value_t value);
+size_t value_size (struct value *value);
+
+void value_print (value_t value, FILE *fd);
 
 bool value_type_match (size_t type, size_t n, ...);
 const char *value_type_string (size_t type);
 
 #endif // VALUE_H
-
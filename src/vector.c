@@ -0,0 +1,291 @@
+#include "vector.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Nodes created so far, for `--stats`.
+static size_t created;
+
+// Transient vectors created so far; each one owns the nodes it creates.
+static size_t owners;
+
+static struct vector_node *
+vector_node_create (size_t owner)
+{
+  struct vector_node *node = calloc (1, sizeof (struct vector_node));
+
+  created++;
+
+  node->references = 1;
+  node->owner = owner;
+
+  return node;
+}
+
+static void
+vector_node_release (struct vector_node *node, size_t shift)
+{
+  if (node == NULL || --node->references > 0)
+    return;
+
+  if (shift > 0)
+    for (size_t i = 0; i < VECTOR_WIDTH; ++i)
+      vector_node_release (node->children[i], shift - VECTOR_BITS);
+
+  free (node);
+}
+
+// Returns the node in `*slot`, first replacing it with a copy unless
+// `vector` is transient and the node is its own and not shared.
+static struct vector_node *
+vector_edit (struct vector *vector, struct vector_node **slot, size_t shift)
+{
+  struct vector_node *node = *slot;
+
+  if (node != NULL && vector->owner != 0 && node->owner == vector->owner
+      && node->references == 1)
+    return node;
+
+  struct vector_node *copy = vector_node_create (vector->owner);
+
+  if (node != NULL)
+    {
+      memcpy (copy->items, node->items, sizeof (copy->items));
+
+      if (shift > 0)
+        for (size_t i = 0; i < VECTOR_WIDTH; ++i)
+          if (copy->children[i] != NULL)
+            copy->children[i]->references++;
+
+      vector_node_release (node, shift);
+    }
+
+  return *slot = copy;
+}
+
+static void
+vector_store (struct vector *vector, size_t index, value_t value)
+{
+  while (index >> vector->shift >= VECTOR_WIDTH)
+    {
+      if (vector->root != NULL)
+        {
+          struct vector_node *root = vector_node_create (vector->owner);
+
+          root->children[0] = vector->root;
+          vector->root = root;
+        }
+
+      vector->shift += VECTOR_BITS;
+    }
+
+  struct vector_node **slot = &vector->root;
+
+  for (size_t shift = vector->shift;; shift -= VECTOR_BITS)
+    {
+      struct vector_node *node = vector_edit (vector, slot, shift);
+
+      if (shift == 0)
+        {
+          node->items[index & VECTOR_MASK] = value;
+          return;
+        }
+
+      slot = &node->children[(index >> shift) & VECTOR_MASK];
+    }
+}
+
+// Drops everything outside items `first` to `last` of the subtree in
+// `*slot`. Only the two paths to the ends of the range are copied.
+static void
+vector_trim (struct vector *vector, struct vector_node **slot, size_t shift,
+             size_t first, size_t last)
+{
+  size_t mask = ((size_t)1 << shift) - 1;
+  size_t low = first >> shift;
+  size_t high = last >> shift;
+
+  if (first == 0 && last == ((size_t)VECTOR_WIDTH << shift) - 1)
+    return;
+
+  struct vector_node *node = vector_edit (vector, slot, shift);
+
+  for (size_t i = 0; i < VECTOR_WIDTH; ++i)
+    if (i < low || i > high)
+      {
+        if (shift == 0)
+          node->items[i] = VALUE_NONE;
+        else
+          {
+            vector_node_release (node->children[i], shift - VECTOR_BITS);
+            node->children[i] = NULL;
+          }
+      }
+
+  if (shift == 0)
+    return;
+
+  vector_trim (vector, &node->children[low], shift - VECTOR_BITS,
+               first & mask, low == high ? last & mask : mask);
+
+  if (high > low)
+    vector_trim (vector, &node->children[high], shift - VECTOR_BITS, 0,
+                 last & mask);
+}
+
+static struct vector_node *
+vector_leaf (struct vector *vector, size_t index)
+{
+  struct vector_node *node = vector->root;
+
+  for (size_t shift = vector->shift; shift > 0; shift -= VECTOR_BITS)
+    node = node->children[(index >> shift) & VECTOR_MASK];
+
+  return node;
+}
+
+struct vector *
+vector_create (struct pool *pool)
+{
+  return pool_allocate (pool, sizeof (struct vector));
+}
+
+struct vector *
+vector_copy (struct pool *pool, struct vector *vector)
+{
+  struct vector *copy = pool_allocate (pool, sizeof (struct vector));
+
+  *copy = *vector;
+  copy->owner = 0;
+
+  if (copy->root != NULL)
+    copy->root->references++;
+
+  return copy;
+}
+
+void
+vector_transient (struct vector *vector)
+{
+  vector->owner = ++owners;
+}
+
+void
+vector_persist (struct vector *vector)
+{
+  vector->owner = 0;
+}
+
+void
+vector_destroy (struct pool *pool, struct vector *vector)
+{
+  vector_node_release (vector->root, vector->shift);
+  pool_free (pool, vector);
+}
+
+value_t
+vector_get (struct vector *vector, size_t index)
+{
+  assert (index < vector->length);
+
+  index += vector->offset;
+
+  return vector_leaf (vector, index)->items[index & VECTOR_MASK];
+}
+
+// Returns the items from `index` to the end of its leaf, and sets `*count`
+// to how many of them belong to the vector.
+const value_t *
+vector_chunk (struct vector *vector, size_t index, size_t *count)
+{
+  size_t position = vector->offset + index;
+  size_t available = VECTOR_WIDTH - (position & VECTOR_MASK);
+
+  assert (index < vector->length);
+
+  *count = vector->length - index < available ? vector->length - index
+                                              : available;
+
+  return &vector_leaf (vector, position)->items[position & VECTOR_MASK];
+}
+
+void
+vector_push (struct vector *vector, value_t value)
+{
+  vector_store (vector, vector->offset + vector->length, value);
+  vector->length++;
+}
+
+// Appends `count` items a leaf at a time: storing the first item of each
+// run makes its leaf one the vector may change, and the rest are copied.
+void
+vector_push_items (struct vector *vector, const value_t *items, size_t count)
+{
+  while (count > 0)
+    {
+      size_t position = vector->offset + vector->length;
+      size_t available = VECTOR_WIDTH - (position & VECTOR_MASK);
+      size_t n = count < available ? count : available;
+
+      vector_store (vector, position, items[0]);
+      memcpy (&vector_leaf (vector, position)->items[position & VECTOR_MASK],
+              items, n * sizeof (value_t));
+
+      vector->length += n;
+      items += n;
+      count -= n;
+    }
+}
+
+void
+vector_set (struct vector *vector, size_t index, value_t value)
+{
+  assert (index < vector->length);
+
+  vector_store (vector, vector->offset + index, value);
+}
+
+// Keeps the items from `start` up to (but not including) `end`. The tree
+// loses the levels the range no longer needs.
+void
+vector_slice (struct vector *vector, size_t start, size_t end)
+{
+  assert (start <= end && end <= vector->length);
+
+  vector->offset += start;
+  vector->length = end - start;
+
+  if (vector->length == 0)
+    {
+      vector_node_release (vector->root, vector->shift);
+      vector->root = NULL;
+      vector->shift = 0;
+      vector->offset = 0;
+      return;
+    }
+
+  size_t last = vector->offset + vector->length - 1;
+
+  while (vector->shift > 0
+         && vector->offset >> vector->shift == last >> vector->shift)
+    {
+      size_t index = vector->offset >> vector->shift;
+      struct vector_node *child = vector->root->children[index];
+
+      child->references++;
+      vector_node_release (vector->root, vector->shift);
+
+      vector->root = child;
+      vector->offset -= index << vector->shift;
+      last -= index << vector->shift;
+      vector->shift -= VECTOR_BITS;
+    }
+
+  vector_trim (vector, &vector->root, vector->shift, vector->offset, last);
+}
+
+size_t
+vector_count (void)
+{
+  return created;
+}
@@ -0,0 +1,65 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "pool.h"
+#include "value.h"
+
+#define VECTOR_BITS 5
+#define VECTOR_WIDTH (1 << VECTOR_BITS)
+#define VECTOR_MASK (VECTOR_WIDTH - 1)
+
+// A node of the radix tree: leaves hold items, inner nodes hold children.
+// Nodes are shared between vectors and reference counted; `owner` names the
+// transient vector that may still change the node in place, and `epoch`
+// belongs to the collector (see gc.h).
+struct vector_node
+{
+  size_t references;
+  size_t owner;
+  size_t epoch;
+
+  union
+  {
+    struct vector_node *children[VECTOR_WIDTH];
+    value_t items[VECTOR_WIDTH];
+  };
+};
+
+// Persistent vector: a radix tree of VECTOR_WIDTH-wide nodes whose items
+// `offset` to `offset + length` are the elements. Updates copy the path to
+// the changed leaf and share everything else, so pushing, setting and
+// slicing all take O(log n). Slices drop the nodes and items outside their
+// range, so they never keep the rest of the original alive.
+//
+// A transient vector (`owner` non-zero) changes the nodes it created in
+// place instead, which is how whole arrays are built. A vector may only be
+// made transient while nobody else can see it, and stays so until
+// `vector_persist ()`.
+struct vector
+{
+  struct vector_node *root;
+  size_t shift;
+  size_t offset;
+  size_t length;
+  size_t owner;
+};
+
+struct vector *vector_create (struct pool *pool);
+struct vector *vector_copy (struct pool *pool, struct vector *vector);
+void vector_transient (struct vector *vector);
+void vector_persist (struct vector *vector);
+void vector_destroy (struct pool *pool, struct vector *vector);
+
+value_t vector_get (struct vector *vector, size_t index);
+const value_t *vector_chunk (struct vector *vector, size_t index,
+                             size_t *count);
+
+void vector_push (struct vector *vector, value_t value);
+void vector_push_items (struct vector *vector, const value_t *items,
+                        size_t count);
+void vector_set (struct vector *vector, size_t index, value_t value);
+void vector_slice (struct vector *vector, size_t start, size_t end);
+
+size_t vector_count (void);
+
+#endif // VECTOR_H
@@ -0,0 +1,645 @@
+#include "vm.h"
+#include "array.h"
+#include "builtins.h"
+#include "common.h"
+#include "vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (size_t)(ip[-2] << 8 | ip[-1]))
+
+#define PUSH(value) (*vm->top++ = (value))
+#define POP() (*--vm->top)
+#define PEEK(distance) (vm->top[-1 - (distance)])
+
+// VMs created so far; each one's id is its number.
+static size_t vms;
+
+static size_t
+vm_line (struct frame *frame)
+{
+  struct chunk *chunk = &frame->closure->function->chunk;
+  return chunk->lines[frame->ip - chunk->code - 1];
+}
+
+static struct environment *
+vm_environment (struct vm *vm, struct environment *parent,
+                struct function *function)
+{
+  struct environment *environment;
+
+  vm->gc.bytes += environment_size (function->slots);
+
+  if (vm->gc.bytes > vm->gc.threshold)
+    gc_collect (vm);
+
+  environment = environment_create (vm->pool, parent, function->names,
+                                    function->slots);
+
+  array_append (vm->environments, &environment);
+
+  return environment;
+}
+
+static void
+vm_push_frame (struct vm *vm, struct closure *closure, value_t *slots,
+               struct environment *environment, size_t line)
+{
+  struct function *function = closure->function;
+
+  if (vm->depth == VM_FRAMES_SIZE
+      || slots + function->stack_size > vm->stack + VM_STACK_SIZE)
+    error (line, "stack overflow");
+
+  struct frame *frame = &vm->frames[vm->depth++];
+
+  frame->closure = closure;
+  frame->ip = function->chunk.code;
+  frame->slots = slots;
+  frame->environment = environment;
+
+  vm->top = slots + 1;
+
+  if (!function->captured)
+    for (vm->top += function->arity; vm->top <= slots + function->slots;)
+      *vm->top++ = VALUE_NONE;
+}
+
+static void
+vm_call_closure (struct vm *vm, struct closure *closure, size_t argc,
+                 size_t line)
+{
+  struct function *function = closure->function;
+  value_t *arguments = vm->top - argc;
+  struct environment *environment = closure->environment;
+
+  if (function->captured)
+    {
+      environment = vm_environment (vm, environment, function);
+      memcpy (environment->slots, arguments, argc * sizeof (value_t));
+    }
+
+  vm_push_frame (vm, closure, arguments - 1, environment, line);
+}
+
+// Returns the cell of global `name`.
+static size_t
+vm_cell (struct vm *vm, struct frame *frame, uint8_t *ip, const char *name)
+{
+  value_t cell = hash_table_find (vm->globals, name);
+
+  if (cell == VALUE_NONE)
+    {
+      frame->ip = ip;
+      error (vm_line (frame), "undefined identifier `%s`", name);
+    }
+
+  return value_as_integer (cell);
+}
+
+// Variables that are read before their declaration ran fall back to the
+// globals, as a lookup by name would.
+static value_t
+vm_global (struct vm *vm, struct frame *frame, uint8_t *ip, const char *name)
+{
+  return vm->cells[vm_cell (vm, frame, ip, name)];
+}
+
+static struct environment *
+vm_hop (struct environment *environment, size_t hops)
+{
+  while (hops-- > 0)
+    environment = environment->parent;
+
+  return environment;
+}
+
+static value_t
+vm_index (struct value *array, value_t index, size_t line)
+{
+  struct vector *vector = array->p;
+
+  if (VALUE_TAG (index) != TAG_INTEGER)
+    error (line, "array index must be INTEGER, got %s",
+           value_type_string (value_type (index)));
+
+  int i = value_as_integer (index);
+
+  if (i < 0 || (size_t)i >= vector->length)
+    error (line, "array index %i out of range", i);
+
+  return vector_get (vector, i);
+}
+
+// Looks field `name` up in `structure`, and remembers where it was in a free
+// way of `cache`, if one is given.
+static value_t
+vm_field (struct structure *structure, value_t name, struct cache *cache,
+          size_t line)
+{
+  struct shape *shape = structure->shape;
+
+  if (VALUE_TAG (name) != TAG_SYMBOL)
+    error (line, "structure field must be SYMBOL, got %s",
+           value_type_string (value_type (name)));
+
+  size_t slot = shape_find (shape, value_as_symbol (name));
+
+  if (slot == SHAPE_NONE)
+    error (line, "structure has no field `%s`", value_as_symbol (name));
+
+  for (size_t way = 0; cache != NULL && way < CACHE_WAYS; ++way)
+    if (cache->shapes[way] == NULL)
+      {
+        cache->shapes[way] = shape;
+        cache->slots[way] = slot;
+        break;
+      }
+
+  return structure->slots[slot];
+}
+
+// `cache` remembers the last function or native whose arity matched, so
+// calling it again skips the check. It may be NULL.
+static void
+vm_call (struct vm *vm, size_t argc, struct cache *cache, size_t line)
+{
+  value_t callee = PEEK (argc);
+  value_t result;
+
+  if (!VALUE_IS_OBJECT (callee))
+    error (line, "cannot invoke value of type %s",
+           value_type_string (value_type (callee)));
+
+  struct value *object = value_as_object (callee);
+
+  switch (object->type)
+    {
+    case TYPE_FUNTION:
+      {
+        struct closure *closure = object->p;
+        struct function *function = closure->function;
+
+        if (cache == NULL || cache->callee != function)
+          {
+            if (argc != function->arity)
+              error (line, "function expects %zu arguments, got %zu",
+                     function->arity, argc);
+
+            if (cache != NULL)
+              cache->callee = function;
+          }
+
+        vm_call_closure (vm, closure, argc, line);
+        return;
+      }
+    case TYPE_NATIVE:
+      {
+        struct native *native = object->p;
+
+        if (cache == NULL || cache->callee != native)
+          {
+            if (native->arity != NATIVE_VARIADIC && argc != native->arity)
+              error (line, "`%s` expects %zu arguments, got %zu",
+                     native->name, native->arity, argc);
+
+            if (cache != NULL)
+              cache->callee = native;
+          }
+
+        result = native->function (vm, argc, vm->top - argc, line);
+        break;
+      }
+    case TYPE_ARRAY:
+      if (argc != 1)
+        error (line, "array expects 1 index, got %zu", argc);
+      result = vm_index (object, PEEK (0), line);
+      break;
+    case TYPE_STRUCTURE:
+      if (argc != 1)
+        error (line, "structure expects 1 field, got %zu", argc);
+      result = vm_field (object->p, PEEK (0), NULL, line);
+      break;
+    default:
+      error (line, "cannot invoke value of type %s",
+             value_type_string (object->type));
+    }
+
+  vm->top -= argc + 1;
+  PUSH (result);
+}
+
+// A function called in tail position replaces the current frame: its
+// callee and `argc` arguments move down to where this frame's were.
+static inline void
+vm_replace (struct vm *vm, struct frame *frame, size_t argc)
+{
+  value_t *slots = frame->slots;
+
+  memmove (slots, vm->top - argc - 1, (argc + 1) * sizeof (value_t));
+  vm->top = slots + argc + 1;
+  vm->depth--;
+}
+
+static value_t
+vm_execute (struct vm *vm)
+{
+  struct frame *frame = &vm->frames[vm->depth - 1];
+  value_t *constants = frame->closure->function->chunk.constants;
+  struct cache *caches = frame->closure->function->chunk.caches;
+  uint8_t *ip = frame->ip;
+
+  for (;;)
+    switch (READ_BYTE ())
+      {
+      case OP_CONSTANT:
+        PUSH (constants[READ_SHORT ()]);
+        break;
+      case OP_VOID:
+        PUSH (VALUE_VOID);
+        break;
+      case OP_POP:
+        vm->top--;
+        break;
+
+      case OP_GET_GLOBAL:
+        {
+          const char *name = value_as_symbol (constants[READ_SHORT ()]);
+          struct cache *cache = &caches[READ_SHORT ()];
+
+          if (cache->owner != vm->id)
+            {
+              cache->cell = vm_cell (vm, frame, ip, name);
+              cache->owner = vm->id;
+            }
+
+          PUSH (vm->cells[cache->cell]);
+          break;
+        }
+      case OP_DEFINE_GLOBAL:
+        vm_define (vm, value_as_symbol (constants[READ_SHORT ()]), PEEK (0));
+        break;
+      case OP_GET_LOCAL:
+        {
+          size_t slot = READ_SHORT ();
+          value_t value = frame->slots[1 + slot];
+
+          if (value == VALUE_NONE)
+            value = vm_global (vm, frame, ip,
+                               frame->closure->function->names[slot]);
+
+          PUSH (value);
+          break;
+        }
+      case OP_SET_LOCAL:
+        frame->slots[1 + READ_SHORT ()] = PEEK (0);
+        break;
+      case OP_GET_CAPTURED:
+        {
+          struct environment *environment;
+          size_t slot;
+
+          environment = vm_hop (frame->environment, READ_BYTE ());
+          slot = READ_SHORT ();
+
+          value_t value = environment->slots[slot];
+
+          if (value == VALUE_NONE)
+            value = vm_global (vm, frame, ip, environment->names[slot]);
+
+          PUSH (value);
+          break;
+        }
+      case OP_SET_CAPTURED:
+        {
+          struct environment *environment;
+
+          environment = vm_hop (frame->environment, READ_BYTE ());
+          environment->slots[READ_SHORT ()] = PEEK (0);
+          break;
+        }
+
+      case OP_CLOSURE:
+        {
+          struct chunk *chunk = &frame->closure->function->chunk;
+          struct closure *closure;
+          struct value *value = vm_allocate (vm, TYPE_FUNTION);
+
+          closure = pool_allocate (vm->pool, sizeof (struct closure));
+          closure->function = chunk->functions[READ_SHORT ()];
+          closure->environment = frame->environment;
+          value->p = closure;
+
+          PUSH (value_object (value));
+          break;
+        }
+      case OP_CALL:
+        {
+          size_t argc = READ_BYTE ();
+          struct cache *cache = &caches[READ_SHORT ()];
+
+          frame->ip = ip;
+          vm_call (vm, argc, cache, vm_line (frame));
+
+          frame = &vm->frames[vm->depth - 1];
+          constants = frame->closure->function->chunk.constants;
+          caches = frame->closure->function->chunk.caches;
+          ip = frame->ip;
+          break;
+        }
+      case OP_TAIL_CALL:
+        {
+          size_t argc = READ_BYTE ();
+          struct cache *cache = &caches[READ_SHORT ()];
+          value_t callee = PEEK (argc);
+          size_t line;
+
+          frame->ip = ip;
+          line = vm_line (frame);
+
+          if (value_type (callee) == TYPE_FUNTION)
+            vm_replace (vm, frame, argc);
+
+          vm_call (vm, argc, cache, line);
+
+          frame = &vm->frames[vm->depth - 1];
+          constants = frame->closure->function->chunk.constants;
+          caches = frame->closure->function->chunk.caches;
+          ip = frame->ip;
+          break;
+        }
+      case OP_GET_FIELD:
+      case OP_TAIL_GET_FIELD:
+        {
+          bool tail = ip[-1] == OP_TAIL_GET_FIELD;
+          value_t name = constants[READ_SHORT ()];
+          struct cache *cache = &caches[READ_SHORT ()];
+          value_t callee = PEEK (0);
+          size_t line;
+
+          if (value_type (callee) == TYPE_STRUCTURE)
+            {
+              struct structure *structure = value_as_object (callee)->p;
+              struct shape *shape = structure->shape;
+              size_t way = 0;
+
+              while (way < CACHE_WAYS && cache->shapes[way] != shape)
+                way++;
+
+              if (way < CACHE_WAYS)
+                vm->top[-1] = structure->slots[cache->slots[way]];
+              else
+                {
+                  frame->ip = ip;
+                  vm->top[-1] = vm_field (structure, name, cache,
+                                          vm_line (frame));
+                }
+              break;
+            }
+
+          PUSH (name);
+
+          frame->ip = ip;
+          line = vm_line (frame);
+
+          if (tail && value_type (callee) == TYPE_FUNTION)
+            vm_replace (vm, frame, 1);
+
+          vm_call (vm, 1, NULL, line);
+
+          frame = &vm->frames[vm->depth - 1];
+          constants = frame->closure->function->chunk.constants;
+          caches = frame->closure->function->chunk.caches;
+          ip = frame->ip;
+          break;
+        }
+      case OP_ARRAY:
+        {
+          size_t count = READ_SHORT ();
+          struct vector *vector = vector_create (vm->pool);
+
+          vector_transient (vector);
+
+          for (size_t i = count; i > 0; --i)
+            vector_push (vector, PEEK (i - 1));
+
+          vector_persist (vector);
+
+          value_t value = vm_array (vm, vector);
+
+          vm->top -= count;
+          PUSH (value);
+          break;
+        }
+      case OP_APPEND:
+        {
+          size_t count = READ_SHORT ();
+          struct vector *vector = value_as_object (PEEK (count))->p;
+
+          // The array is the one the preceding OP_ARRAY created, which
+          // nothing else can see yet. So is OP_EXTEND's.
+          vector_transient (vector);
+
+          for (size_t i = count; i > 0; --i)
+            vector_push (vector, PEEK (i - 1));
+
+          vector_persist (vector);
+
+          vm->top -= count;
+          break;
+        }
+      case OP_EXTEND:
+        {
+          struct vector *items = value_as_object (POP ())->p;
+          struct vector *vector = value_as_object (PEEK (0))->p;
+
+          vector_transient (vector);
+
+          for (size_t i = 0, count; i < items->length; i += count)
+            {
+              const value_t *chunk = vector_chunk (items, i, &count);
+
+              vector_push_items (vector, chunk, count);
+            }
+
+          vector_persist (vector);
+          break;
+        }
+      case OP_STRUCTURE:
+        {
+          size_t count = READ_SHORT ();
+          struct cache *cache = &caches[READ_SHORT ()];
+          struct value *value = vm_allocate (vm, TYPE_STRUCTURE);
+          struct structure *structure;
+
+          if (cache->shapes[0] == NULL)
+            {
+              struct shape *shape = shape_root ();
+
+              for (size_t i = 0; i < count; ++i)
+                shape = shape_add (shape,
+                                   value_as_symbol (constants[READ_SHORT ()]));
+
+              cache->shapes[0] = shape;
+            }
+          else
+            ip += 2 * count;
+
+          structure = structure_create (vm->pool, cache->shapes[0]);
+          memcpy (structure->slots, vm->top - count, count * sizeof (value_t));
+          vm->gc.bytes += structure_size (count);
+
+          value->p = structure;
+
+          vm->top -= count;
+          PUSH (value_object (value));
+          break;
+        }
+
+      case OP_RETURN:
+        {
+          value_t result = POP ();
+
+          vm->top = frame->slots;
+
+          if (--vm->depth == 0)
+            return result;
+
+          PUSH (result);
+
+          frame = &vm->frames[vm->depth - 1];
+          constants = frame->closure->function->chunk.constants;
+          caches = frame->closure->function->chunk.caches;
+          ip = frame->ip;
+          break;
+        }
+      }
+}
+
+struct vm *
+vm_create (void)
+{
+  struct vm *vm;
+
+  vm = calloc (1, sizeof (struct vm));
+  vm->pool = pool_create ();
+  vm->stack = calloc (VM_STACK_SIZE, sizeof (value_t));
+  vm->top = vm->stack;
+  vm->frames = calloc (VM_FRAMES_SIZE, sizeof (struct frame));
+  vm->values = array_create (64, sizeof (struct value *));
+  vm->environments = array_create (16, sizeof (struct environment *));
+
+  gc_init (&vm->gc);
+
+  vm->globals = hash_table_create (vm->pool, 64);
+  vm->cells = array_create (64, sizeof (value_t));
+  vm->id = ++vms;
+
+  builtins_register (vm);
+
+  return vm;
+}
+
+void
+vm_destroy (struct vm *vm)
+{
+  for (size_t i = 0; i < array_length (vm->values); ++i)
+    value_destroy (vm->pool, value_object (vm->values[i]));
+
+  for (size_t i = 0; i < array_length (vm->environments); ++i)
+    environment_destroy (vm->pool, vm->environments[i]);
+
+  hash_table_destroy (vm->globals);
+  array_destroy (vm->cells);
+
+  array_destroy (vm->values);
+  array_destroy (vm->environments);
+
+  gc_destroy (&vm->gc);
+
+  pool_destroy (vm->pool);
+
+  free (vm->frames);
+  free (vm->stack);
+  free (vm);
+}
+
+// Drops every frame, for a VM that an error left in the middle of a run.
+void
+vm_reset (struct vm *vm)
+{
+  vm->depth = 0;
+  vm->top = vm->stack;
+}
+
+void
+vm_define (struct vm *vm, const char *name, value_t value)
+{
+  value_t cell = hash_table_find (vm->globals, name);
+
+  if (cell != VALUE_NONE)
+    {
+      vm->cells[value_as_integer (cell)] = value;
+      return;
+    }
+
+  hash_table_append (vm->globals, name,
+                     value_integer (array_length (vm->cells)));
+  array_append (vm->cells, &value);
+}
+
+struct value *
+vm_allocate (struct vm *vm, size_t type)
+{
+  vm->gc.bytes += sizeof (struct value);
+
+  if (vm->gc.bytes > vm->gc.threshold)
+    gc_collect (vm);
+
+  struct value *value = value_create (vm->pool, type);
+
+  array_append (vm->values, &value);
+
+  return value;
+}
+
+// Wraps `vector` in a new array value. Vector nodes count towards the heap
+// size when they are created, whichever array they end up in.
+value_t
+vm_array (struct vm *vm, struct vector *vector)
+{
+  size_t nodes = vector_count ();
+
+  vm->gc.bytes += (nodes - vm->gc.nodes) * sizeof (struct vector_node);
+  vm->gc.nodes = nodes;
+
+  struct value *value = vm_allocate (vm, TYPE_ARRAY);
+
+  value->p = vector;
+
+  return value_object (value);
+}
+
+void
+vm_print_statistics (struct vm *vm, FILE *fd)
+{
+  pool_print_statistics (vm->pool, fd);
+  gc_print_statistics (&vm->gc, fd);
+}
+
+value_t
+vm_run (struct vm *vm, struct function *function)
+{
+  struct closure *closure = pool_allocate (vm->pool, sizeof (struct closure));
+  struct value *value = vm_allocate (vm, TYPE_FUNTION);
+
+  closure->function = function;
+  closure->environment = NULL;
+  value->p = closure;
+
+  PUSH (value_object (value));
+  vm_push_frame (vm, closure, vm->top - 1, NULL, function->line);
+
+  return vm_execute (vm);
+}
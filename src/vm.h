@@ -0,0 +1,75 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "environment.h"
+#include "gc.h"
+#include "tables.h"
+#include "vector.h"
+
+#define VM_STACK_SIZE (1 << 16)
+#define VM_FRAMES_SIZE (1 << 12)
+
+#define NATIVE_VARIADIC ((size_t)-1)
+
+struct vm;
+
+typedef value_t (native_function_t)(struct vm *, size_t, value_t *, size_t);
+
+struct native
+{
+  const char *name;
+  size_t arity;
+  native_function_t *function;
+};
+
+struct closure
+{
+  struct function *function;
+  struct environment *environment;
+};
+
+// `slots[0]` holds the callee; the variables of a function that is not
+// captured follow it.
+struct frame
+{
+  struct closure *closure;
+  uint8_t *ip;
+  value_t *slots;
+  struct environment *environment;
+};
+
+struct vm
+{
+  struct pool *pool;
+  value_t *stack;
+  value_t *top;
+  struct frame *frames;
+  size_t depth;
+  size_t id;
+
+  // Globals live in `cells`, and `globals` maps their names to cell indices.
+  // A cell keeps its index once defined, so OP_GET_GLOBAL caches the index
+  // for the VM with `id`; `cells` itself moves as it grows, so pointers into
+  // it do not survive a define.
+  struct hash_table *globals;
+  value_t *cells;
+
+  // Every value and environment the VM allocated and the collector has not
+  // freed yet; the rest are released in `vm_destroy ()`.
+  struct value **values;
+  struct environment **environments;
+  struct gc gc;
+};
+
+struct vm *vm_create (void);
+void vm_destroy (struct vm *vm);
+
+void vm_reset (struct vm *vm);
+void vm_define (struct vm *vm, const char *name, value_t value);
+struct value *vm_allocate (struct vm *vm, size_t type);
+value_t vm_array (struct vm *vm, struct vector *vector);
+void vm_print_statistics (struct vm *vm, FILE *fd);
+value_t vm_run (struct vm *vm, struct function *function);
+
+#endif // VM_H
@@ -0,0 +1,261 @@
+// Checks that incremental reparsing gives the same tree as parsing from
+// scratch. Each script is edited at random a number of times, inserting,
+// deleting and replacing text and whole statements, and after every edit
+// the tree from `parser_reparse ()` is compared with a fresh one.
+//
+//   make build/reparse-test
+//   build/reparse-test file...
+
+#include "arena.h"
+#include "array.h"
+#include "intern.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPARSE_EDITS 300
+#define REPARSE_SLACK 4096
+
+// Text inserted by an edit; statements longer than this are not copied.
+#define REPARSE_TEXT 256
+
+struct script
+{
+  char *buffer;
+  size_t length;
+};
+
+static struct ast *
+reparse_full (struct script *script, struct arena *arena)
+{
+  struct lexer *lexer;
+  struct parser *parser;
+  struct ast *ast;
+
+  lexer = lexer_create (script->buffer, script->length, arena, true);
+  parser = parser_create (lexer);
+  ast = parser_parse (parser);
+
+  parser_destroy (parser);
+  lexer_destroy (lexer);
+
+  return ast;
+}
+
+#define EXPECT(condition)                                                     \
+  do                                                                          \
+    if (!(condition))                                                         \
+      {                                                                       \
+        fprintf (stderr, "mismatch: %s\n", #condition);                       \
+        return false;                                                         \
+      }                                                                       \
+  while (0)
+
+static bool
+reparse_same (struct ast *x, struct ast *y)
+{
+  size_t n = x->length;
+
+  EXPECT (x->length == y->length);
+  EXPECT (x->root == y->root);
+  EXPECT (memcmp (x->types, y->types, n * sizeof (*x->types)) == 0);
+  EXPECT (memcmp (x->lines, y->lines, n * sizeof (*x->lines)) == 0);
+  EXPECT (memcmp (x->children, y->children, n * sizeof (node_t)) == 0);
+  EXPECT (memcmp (x->lasts, y->lasts, n * sizeof (node_t)) == 0);
+  EXPECT (memcmp (x->nexts, y->nexts, n * sizeof (node_t)) == 0);
+  EXPECT (memcmp (x->payloads, y->payloads, n * sizeof (*x->payloads)) == 0);
+  EXPECT (x->data_length == y->data_length);
+
+  for (size_t i = 0; i < x->data_length; ++i)
+    {
+      EXPECT (x->data[i].text == y->data[i].text);
+      EXPECT (x->data[i].length == y->data[i].length);
+      EXPECT (memcmp (&x->data[i].as, &y->data[i].as, sizeof (x->data[i].as))
+              == 0);
+    }
+
+  EXPECT (array_length (x->statements) == array_length (y->statements));
+
+  for (size_t i = 0; i < array_length (x->statements); ++i)
+    {
+      struct ast_statement *a = &x->statements[i];
+      struct ast_statement *b = &y->statements[i];
+
+      EXPECT (a->offset == b->offset && a->line == b->line);
+      EXPECT (a->node == b->node && a->first == b->first);
+      EXPECT (a->payload == b->payload);
+    }
+
+  return true;
+}
+
+// Picks an edit that keeps the script valid: a statement deleted or
+// duplicated, a number replaced, an identifier lengthened, or blank lines,
+// a comment or a space inserted before a token.
+static struct parser_edit
+reparse_choose (struct script *script, struct ast *ast, struct arena *arena,
+                char *text)
+{
+  struct parser_edit edit = { 0, 0, 0 };
+  size_t statements = array_length (ast->statements);
+  int kind = rand () % 6;
+
+  text[0] = '\0';
+
+  if (kind >= 4 && statements > 1)
+    {
+      size_t i = rand () % (statements - 1);
+
+      edit.offset = ast->statements[i].offset;
+
+      size_t length = ast->statements[i + 1].offset - edit.offset;
+
+      if (kind == 4 || length >= REPARSE_TEXT)
+        edit.removed = length;
+      else
+        {
+          memcpy (text, &script->buffer[edit.offset], length);
+          text[length] = '\0';
+        }
+    }
+  else
+    {
+      struct lexer *lexer;
+      struct token token;
+      size_t count = 0;
+      size_t chosen;
+
+      lexer = lexer_create (script->buffer, script->length, arena, true);
+      while (lexer_next (lexer).type != TOKEN_EOF)
+        count++;
+      lexer_destroy (lexer);
+
+      if (count == 0)
+        return edit;
+
+      chosen = rand () % count;
+      lexer = lexer_create (script->buffer, script->length, arena, true);
+      do
+        token = lexer_next (lexer);
+      while (chosen-- > 0);
+      lexer_destroy (lexer);
+
+      edit.offset = token.offset;
+
+      if (kind == 0)
+        strcpy (text, "\n\n");
+      else if (kind == 1)
+        strcpy (text, " -- inserted\n");
+      else if (kind == 2 && token.type == TOKEN_INTEGER)
+        {
+          snprintf (text, REPARSE_TEXT, "%d", rand () % 100000);
+          edit.removed = token.length;
+        }
+      else if (kind == 3 && token.type == TOKEN_IDENTIFIER)
+        {
+          strcpy (text, "z");
+          edit.offset += token.length;
+        }
+      else
+        strcpy (text, " ");
+    }
+
+  edit.inserted = strlen (text);
+
+  return edit;
+}
+
+static void
+reparse_apply (struct script *script, const struct parser_edit *edit,
+               const char *text)
+{
+  char *at = &script->buffer[edit->offset];
+
+  memmove (at + edit->inserted, at + edit->removed,
+           script->length - edit->offset - edit->removed);
+  memcpy (at, text, edit->inserted);
+  script->length += edit->inserted - edit->removed;
+}
+
+static bool
+reparse_check (const char *path)
+{
+  struct script script;
+  struct arena *arena;
+  struct ast *ast;
+  char text[REPARSE_TEXT];
+  FILE *fd;
+  bool passed = true;
+
+  if ((fd = fopen (path, "rb")) == NULL)
+    {
+      perror (path);
+      return false;
+    }
+
+  fseek (fd, 0, SEEK_END);
+  script.length = ftell (fd);
+  rewind (fd);
+
+  // Statements are duplicated, so leave room for the script to grow.
+  script.buffer = malloc (script.length + REPARSE_EDITS * REPARSE_TEXT
+                          + REPARSE_SLACK);
+  script.length = fread (script.buffer, 1, script.length, fd);
+  fclose (fd);
+
+  arena = arena_create (ARENA_BLOCK_SIZE);
+  ast = reparse_full (&script, arena);
+
+  for (int i = 0; i < REPARSE_EDITS && passed; ++i)
+    {
+      struct parser_edit edit = reparse_choose (&script, ast, arena, text);
+      struct lexer *lexer;
+      struct parser *parser;
+      struct ast *expected;
+
+      reparse_apply (&script, &edit, text);
+
+      lexer = lexer_create (script.buffer, script.length, arena, true);
+      parser = parser_create (lexer);
+      ast = parser_reparse (parser, ast, &edit, 1);
+      parser_destroy (parser);
+      lexer_destroy (lexer);
+
+      expected = reparse_full (&script, arena);
+
+      if (!reparse_same (ast, expected))
+        {
+          fprintf (stderr, "%s: edit %d at offset %zu (-%zu +%zu) differs\n",
+                   path, i, edit.offset, edit.removed, edit.inserted);
+          passed = false;
+        }
+
+      ast_destroy (expected);
+    }
+
+  ast_destroy (ast);
+  arena_destroy (arena);
+  free (script.buffer);
+
+  return passed;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int failed = 0;
+
+  srand (1);
+
+  for (int i = 1; i < argc; ++i)
+    failed += !reparse_check (argv[i]);
+
+  printf ("reparse: %d of %d scripts passed\n", argc - 1 - failed, argc - 1);
+  intern_destroy ();
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
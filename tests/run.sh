@@ -0,0 +1,80 @@
+#!/bin/sh
+# Runs the tests in this directory with the interpreter given as the only
+# argument, and compares what each prints with NAME.out: its standard
+# output, then its standard error, then its exit status when not zero.
+#
+#   NAME.sl    a script, run with the flags on a first line "-- flags: ..."
+#   NAME.repl  standard input for `-i`
+#
+# Scripts are run once more with `--cache`, once again to load the tree
+# that run stored, and once with that tree damaged, which must be a miss,
+# and must print the same each time.
+
+set -u
+
+program=${1:?usage: tests/run.sh interpreter}
+directory=$(dirname "$0")
+temporary=$(mktemp -d)
+failed=0
+count=0
+
+trap 'rm -rf "$temporary"' EXIT
+
+# run LABEL EXPECTED COMMAND...
+run ()
+{
+  label=$1
+  expected=$2
+  shift 2
+
+  "$@" > "$temporary/out" 2> "$temporary/err"
+  status=$?
+  cat "$temporary/err" >> "$temporary/out"
+
+  if [ $status -ne 0 ]; then
+    echo "exit $status" >> "$temporary/out"
+  fi
+
+  count=$((count + 1))
+
+  if ! cmp -s "$temporary/out" "$expected"; then
+    echo "FAIL $label"
+    diff "$expected" "$temporary/out" | head -20
+    failed=$((failed + 1))
+  fi
+}
+
+for test in "$directory"/*.sl; do
+  name=$(basename "$test" .sl)
+  flags=$(sed -n '1s/^-- flags: //p' "$test")
+
+  # The flags are split into words on purpose.
+  run "$name" "${test%.sl}.out" "$program" $flags "$test"
+  run "$name (cache store)" "${test%.sl}.out" \
+    "$program" $flags --cache "$temporary/cache" "$test"
+  run "$name (cache load)" "${test%.sl}.out" \
+    "$program" $flags --cache "$temporary/cache" "$test"
+
+  # Turns a few nodes into declarations that declare nothing.
+  for file in "$temporary"/cache/*; do
+    printf '\2\2\2\2' | dd of="$file" bs=1 seek=60 conv=notrunc 2> /dev/null
+  done
+
+  run "$name (cache damaged)" "${test%.sl}.out" \
+    "$program" $flags --cache "$temporary/cache" "$test"
+done
+
+for test in "$directory"/*.repl; do
+  run "$(basename "$test")" "${test%.repl}.out" "$program" -i < "$test"
+done
+
+stored=$(ls "$temporary/cache" | wc -l)
+scripts=$(ls "$directory"/*.sl | wc -l)
+
+if [ "$stored" -ne "$scripts" ]; then
+  echo "FAIL cache: $stored trees stored for $scripts scripts"
+  failed=$((failed + 1))
+fi
+
+echo "$((count - failed)) of $count passed"
+[ $failed -eq 0 ]